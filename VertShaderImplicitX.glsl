@@ -0,0 +1,14 @@
+#version 460
+
+layout(location = 0) in float aY;
+
+uniform double xOffset;
+uniform double xMult;
+uniform double xShift;
+uniform double yMult;
+uniform double yShift;
+
+void main() {
+   double x = double(gl_VertexID) + xOffset;
+   gl_Position = vec4(x * xMult + xShift, aY * yMult + yShift, 0.0, 1.0);
+}
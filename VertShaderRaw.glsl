@@ -0,0 +1,17 @@
+#version 460
+
+layout(location = 0) in vec2 aRaw;     //real and imaginary parts
+
+uniform bool phase;
+uniform double xOffset;
+uniform double xMult;
+uniform double xShift;
+uniform double yMult;
+uniform double yShift;
+
+void main() {
+   double x = double(gl_VertexID) + xOffset;
+   //atan is undefined for 0, 0 while atan2 gives 0
+   double y = phase ? (aRaw == vec2(0.0) ? 0.0 : atan(aRaw.y, aRaw.x)) : length(aRaw);
+   gl_Position = vec4(x * xMult + xShift, y * yMult + yShift, 0.0, 1.0);
+}
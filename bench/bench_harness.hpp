@@ -0,0 +1,106 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+//Minimal timing harness for the benchmark target.
+//Every benchmark is a callable that performs one iteration, the harness
+//repeats it until both minIterations and minTime are reached and keeps
+//a per-iteration sample for the percentiles.
+class BenchRunner {
+public:
+
+    struct Settings {
+        double minTime = 0.5;           //seconds per benchmark
+        size_t minIterations = 5;
+        size_t maxIterations = 1000000;
+        size_t warmup = 1;
+        std::string filter;             //run only benchmarks containing this substring
+    };
+
+    BenchRunner(Settings settings) :
+        settings(settings)
+    {}
+
+    bool enabled(const std::string& name) const {
+        return settings.filter.empty() || name.find(settings.filter) != std::string::npos;
+    }
+
+    //itemsPerIteration is what items/s is computed from (packets, points, rows...)
+    void run(const std::string& name, double itemsPerIteration, std::function<void()> iteration,
+             size_t maxIterations = 0)
+    {
+        if(!enabled(name))
+            return;
+        if(maxIterations == 0)
+            maxIterations = settings.maxIterations;
+
+        using clock = std::chrono::steady_clock;
+        for(size_t i = 0; i < settings.warmup; i++) {
+            iteration();
+        }
+
+        std::vector<double> samples;
+        const auto start = clock::now();
+        while(samples.size() < maxIterations) {
+            auto iterStart = clock::now();
+            iteration();
+            auto iterEnd = clock::now();
+            samples.push_back(std::chrono::duration<double, std::nano>(iterEnd - iterStart).count());
+
+            double elapsed = std::chrono::duration<double>(iterEnd - start).count();
+            if(samples.size() >= settings.minIterations && elapsed >= settings.minTime)
+                break;
+        }
+        report(name, itemsPerIteration, std::move(samples));
+    }
+
+    void skip(const std::string& name, const std::string& reason) {
+        if(!enabled(name))
+            return;
+        std::cerr << name << ": skipped, " << reason << std::endl;
+        results.push_back({{"name", name}, {"skipped", reason}});
+    }
+
+    nlohmann::json getResults() const {
+        return results;
+    }
+
+private:
+    Settings settings;
+    nlohmann::json results = nlohmann::json::array();
+
+    void report(const std::string& name, double itemsPerIteration, std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for(double s : samples) {
+            sum += s;
+        }
+        auto percentile = [&samples](double p) {
+            size_t idx = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+            return samples[idx];
+        };
+
+        double mean = sum / samples.size();
+        nlohmann::json res;
+        res["name"] = name;
+        res["iterations"] = samples.size();
+        res["mean_ns"] = mean;
+        res["median_ns"] = percentile(0.5);
+        res["p99_ns"] = percentile(0.99);
+        res["min_ns"] = samples.front();
+        res["max_ns"] = samples.back();
+        res["items_per_iteration"] = itemsPerIteration;
+        res["items_per_second"] = itemsPerIteration / (mean * 1e-9);
+        results.push_back(res);
+
+        std::cerr << name << ": " << mean << " ns/iter, "
+                  << res["items_per_second"].get<double>() << " items/s ("
+                  << samples.size() << " iterations)" << std::endl;
+    }
+};
@@ -0,0 +1,459 @@
+//Benchmark suite for the decode, ingest, query and render hot paths.
+//Results are written as JSON (stdout or --out FILE), so runs on different
+//commits can be compared. Every input is generated from a fixed seed.
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <random>
+#include <ctime>
+#include <epoxy/gl.h>
+#include <epoxy/egl.h>
+
+#include "bench_harness.hpp"
+#include "csi_encoder.hpp"
+#include "csi_parser.hpp"
+#include "experiments_list.hpp"
+#include "PlotRenderer.hpp"
+#include "preprocessors.hpp"
+#include "spectrogram.hpp"
+#include "pca.hpp"
+
+extern "C" {
+#include "csi_fun.h"
+}
+
+namespace
+{
+
+struct Options {
+    std::string out;
+    std::string workdir = "bench_work";
+    size_t packets = 20000;         //size of the generated experiment, 504 measurements each
+    size_t width = 1280;
+    size_t height = 720;
+    uint64_t seed = 42;
+    BenchRunner::Settings runner;
+};
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for(int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if(i + 1 >= argc) {
+            std::cerr << "Usage: " << argv[0] << " [--out FILE] [--filter STR] [--packets N] [--min-time SEC]"
+                      << " [--workdir DIR] [--width N] [--height N] [--seed N]" << std::endl;
+            return false;
+        }
+        std::string val = argv[++i];
+        if(key == "--out")           opt.out = val;
+        else if(key == "--filter")   opt.runner.filter = val;
+        else if(key == "--packets")  opt.packets = std::stoul(val);
+        else if(key == "--min-time") opt.runner.minTime = std::stod(val);
+        else if(key == "--workdir")  opt.workdir = val;
+        else if(key == "--width")    opt.width = std::stoul(val);
+        else if(key == "--height")   opt.height = std::stoul(val);
+        else if(key == "--seed")     opt.seed = std::stoull(val);
+        else {
+            std::cerr << "Unknown option " << key << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//same conversion RouterReceiver::tryCollect does
+HandlerBase::datatype decodeToFrame(const std::vector<unsigned char>& datagram) {
+    HandlerBase::datatype frame;
+    auto parsed = CsiParser::Datagram::parse(datagram);
+    if(parsed)
+        parsed->decode(frame, 3, 3, 114);
+    return frame;
+}
+
+void decodeBenchmarks(BenchRunner& runner, const Options& opt) {
+    for(uint8_t tones : {56, 114}) {
+        CsiPacketEncoder::Params params;
+        params.num_tones = tones;
+        CsiPacketEncoder encoder(params, opt.seed);
+        std::vector<unsigned char> datagram;
+        encoder.encodeSynthetic(datagram, 0, 0.0);
+        const std::string shape = "3x3x" + std::to_string(tones);
+
+        const size_t batch = 1000;
+        runner.run("decode/record_status/" + shape, batch, [&datagram]() {
+            csi_struct status;
+            for(size_t i = 0; i < batch; i++) {
+                record_status(datagram.data(), datagram.size(), &status);
+            }
+            asm volatile("" : : "r"(&status) : "memory");
+        });
+
+        runner.run("decode/fill_csi_matrix/" + shape, batch, [&datagram, tones]() {
+            static COMPLEX csi_matrix[3][3][114];
+            for(size_t i = 0; i < batch; i++) {
+                fill_csi_matrix(datagram.data() + CsiPacketEncoder::headerLen + 2, 3, 3, tones, csi_matrix);
+                asm volatile("" : : "r"(csi_matrix) : "memory");
+            }
+        });
+
+        runner.run("decode/parser/" + shape, batch, [&datagram]() {
+            HandlerBase::datatype frame;
+            for(size_t i = 0; i < batch; i++) {
+                auto parsed = CsiParser::Datagram::parse(datagram);
+                parsed->decode(frame, 3, 3, 114);
+                asm volatile("" : : "r"(&frame) : "memory");
+            }
+        });
+
+        runner.run("decode/parser_generic/" + shape, batch, [&datagram]() {
+            HandlerBase::datatype frame;
+            for(size_t i = 0; i < batch; i++) {
+                auto parsed = CsiParser::Datagram::parse(datagram);
+                parsed->decodeGeneric(frame, 3, 3, 114);
+                asm volatile("" : : "r"(&frame) : "memory");
+            }
+        });
+
+        runner.run("decode/datagram_to_frame/" + shape, batch, [&datagram]() {
+            for(size_t i = 0; i < batch; i++) {
+                auto frame = decodeToFrame(datagram);
+                asm volatile("" : : "r"(&frame) : "memory");
+            }
+        });
+    }
+}
+
+Experiment& createExperiment(const std::string& name) {
+    FullExperimentConfig conf;
+    conf.name = name;
+    ExperimentsList& list = ExperimentsList::getInstance();
+    return list.addExperiment(conf);
+}
+
+std::vector<HandlerBase::datatype> makeFrames(size_t count, uint64_t seed) {
+    CsiPacketEncoder encoder(CsiPacketEncoder::Params(), seed);
+    std::vector<HandlerBase::datatype> frames;
+    std::vector<unsigned char> datagram;
+    for(size_t i = 0; i < count; i++) {
+        encoder.encodeSynthetic(datagram, i * 1000, i * 0.001);
+        frames.push_back(decodeToFrame(datagram));
+    }
+    return frames;
+}
+
+void databaseBenchmarks(BenchRunner& runner, const Options& opt) {
+    const auto frames = makeFrames(256, opt.seed);
+
+    if(runner.enabled("ingest/addPoint")) {
+        Experiment& ingestExp = createExperiment("bench_ingest");
+        size_t next = 0;
+        runner.run("ingest/addPoint", 1, [&ingestExp, &frames, &next]() {
+            ingestExp.addPoint(frames[next++ % frames.size()]);
+        }, 20000);
+    }
+
+    if(!runner.enabled("query/") && !runner.enabled("export/"))
+        return;
+
+    std::cerr << "generating experiment with " << opt.packets << " packets..." << std::endl;
+    Experiment& exp = createExperiment("bench_query");
+    {
+        SQLite::Transaction transaction(DB_Handler::get_db());
+        for(size_t i = 0; i < opt.packets; i++) {
+            exp.addPoint(frames[i % frames.size()]);
+        }
+        transaction.commit();
+    }
+
+    runner.run("query/getPoints/amplitude", opt.packets, [&exp]() {
+        auto points = exp.getPoints(1, 1, 20, true);
+        asm volatile("" : : "r"(points.data()) : "memory");
+    }, 20);
+    runner.run("query/getPoints/phase", opt.packets, [&exp]() {
+        auto points = exp.getPoints(2, 0, 40, false);
+        asm volatile("" : : "r"(points.data()) : "memory");
+    }, 20);
+    runner.run("query/getRawPoints", opt.packets, [&exp]() {
+        auto points = exp.getRawPoints(1, 1, 20);
+        asm volatile("" : : "r"(points.data()) : "memory");
+    }, 20);
+    exp.flushRollups();
+    auto range = exp.getTimeRange();
+    if(range) {
+        runner.run("query/getPointsBucketed/1000", 1000, [&exp, &range]() {
+            auto buckets = exp.getPointsBucketed(1, 1, 20, true, range->first, range->second, 1000);
+            asm volatile("" : : "r"(buckets.data()) : "memory");
+        });
+    }
+    runner.run("query/getPacketsCount", 1, [&exp]() {
+        auto count = exp.getPacketsCount();
+        asm volatile("" : : "r"(&count) : "memory");
+    });
+
+    Experiment::ExportFilters filters;
+    filters.ampl = true;
+    filters.phase = true;
+    runner.run("export/exportData/ampl_phase", opt.packets, [&exp, filters]() {
+        std::filesystem::remove_all("export");
+        exp.exportData("export", filters, nullptr);
+    }, 3);
+}
+
+void preprocessBenchmarks(BenchRunner& runner, const Options& opt) {
+    std::vector<HandlerBase::datatype> frames = makeFrames(256, opt.seed);
+    FrameInfo info;
+    info.rssi = 40;
+    info.chainRssi = {38, 39, 40};
+
+    auto benchPreprocessor = [&](const std::string& name, PreprocessingHandler& handler) {
+        handler.set_settings(nlohmann::json::object());
+        size_t next = 0;
+        runner.run("preprocess/" + name + "/3x3x56", 1, [&handler, &frames, &next, &info]() {
+            auto result = handler.process(frames[next], info);
+            next = (next + 1) % frames.size();
+            asm volatile("" : : "r"(&result) : "memory");
+        });
+    };
+
+    HampelFilter hampel;
+    benchPreprocessor("hampel", hampel);
+    MovingAverageFilter movingAverage;
+    benchPreprocessor("moving_average", movingAverage);
+    EwmaFilter ewma;
+    benchPreprocessor("ewma", ewma);
+    PhaseSanitizer phase;
+    benchPreprocessor("phase_sanitizer", phase);
+    RssiNormalizer rssi;
+    benchPreprocessor("rssi_normalizer", rssi);
+    DopplerSpectrogram doppler;
+    benchPreprocessor("doppler", doppler);
+    PcaReducer pca;
+    benchPreprocessor("pca", pca);
+
+    //one full batch transform of all 504 streams
+    BatchFft fft(64);
+    const size_t streams = 3 * 3 * 56;
+    std::vector<double> input(64 * streams), re(64 * streams), im(64 * streams);
+    std::mt19937_64 rng(opt.seed);
+    std::normal_distribution<double> dist;
+    for(double& v : input) v = dist(rng);
+    runner.run("fft/batch/64x504", streams, [&]() {
+        std::copy(input.begin(), input.end(), re.begin());
+        std::fill(im.begin(), im.end(), 0.0);
+        fft.forward(re.data(), im.data(), streams);
+        asm volatile("" : : "r"(re.data()) : "memory");
+    });
+}
+
+void dataSetBenchmarks(BenchRunner& runner, const Options& opt) {
+    std::mt19937_64 rng(opt.seed);
+    std::normal_distribution<double> dist(0, 100);
+
+    std::vector<std::pair<double, double>> ordered(100000);
+    for(size_t i = 0; i < ordered.size(); i++) {
+        ordered[i] = {static_cast<double>(i), dist(rng)};
+    }
+    std::vector<double> ys(ordered.size());
+    for(size_t i = 0; i < ys.size(); i++) {
+        ys[i] = ordered[i].second;
+    }
+
+    //addData sorts whenever a point arrives out of order
+    std::vector<std::pair<double, double>> shuffled(4096);
+    std::copy(ordered.begin(), ordered.begin() + shuffled.size(), shuffled.begin());
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    DataSet ds;
+    runner.run("dataset/addData/ordered_100k", ordered.size(), [&ds, &ordered]() {
+        ds.clear();
+        ds.addData(ordered.begin(), ordered.end());
+    });
+    runner.run("dataset/addDataWithoutX/100k", ys.size(), [&ds, &ys]() {
+        ds.clear();
+        ds.addDataWithoutX(ys.begin(), ys.end());
+    });
+    runner.run("dataset/addDataPoint/100k", ys.size(), [&ds, &ys]() {
+        ds.clear();
+        for(double y : ys) {
+            ds.addDataPoint(y);
+        }
+    });
+    runner.run("dataset/sort/shuffled_4k", shuffled.size(), [&ds, &shuffled]() {
+        ds.clear();
+        ds.addData(shuffled.begin(), shuffled.end());
+    });
+
+    //live plot: a window of 10k points slides over the 100k
+    DataSet window;
+    window.setWindow(10000);
+    runner.run("dataset/addDataPoint/window_10k_of_100k", ys.size(), [&window, &ys]() {
+        window.clear();
+        for(double y : ys) {
+            window.addDataPoint(y);
+        }
+    });
+}
+
+//PlotRenderer with a public way to feed datasets, ExtendablePlot needs a realized widget
+class OffscreenPlot : public PlotRenderer {
+public:
+    void addDataSet(std::shared_ptr<DataSet> ds) {
+        datasets.push_back(ds);
+        ds->signalOnChanged().connect([this](DataSet&) { updateExtremums(); });
+        updateExtremums();
+    }
+};
+
+struct OffscreenContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    unsigned int fbo = 0;
+    unsigned int renderbuffer = 0;
+
+    bool create(size_t width, size_t height, std::string& error) {
+        if(!epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+            error = "EGL_MESA_platform_surfaceless is not supported";
+            return false;
+        }
+        display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        EGLint major, minor;
+        if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            error = "unable to initialize surfaceless EGL display";
+            return false;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        //shaders are #version 460 and use double precision uniforms
+        const EGLint attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 6,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+        if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            error = "unable to create OpenGL 4.6 core context";
+            return false;
+        }
+
+        glCreateRenderbuffers(1, &renderbuffer);
+        glNamedRenderbufferStorage(renderbuffer, GL_RGBA8, width, height);
+        glCreateFramebuffers(1, &fbo);
+        glNamedFramebufferRenderbuffer(fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    ~OffscreenContext() {
+        if(context != EGL_NO_CONTEXT) {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteRenderbuffers(1, &renderbuffer);
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if(display != EGL_NO_DISPLAY)
+            eglTerminate(display);
+    }
+};
+
+void renderBenchmarks(BenchRunner& runner, const Options& opt) {
+    if(!runner.enabled("render/"))
+        return;
+
+    OffscreenContext offscreen;
+    std::string error;
+    if(!offscreen.create(opt.width, opt.height, error)) {
+        runner.skip("render/", error);
+        return;
+    }
+
+    std::mt19937_64 rng(opt.seed);
+    std::normal_distribution<double> dist(0, 100);
+    for(size_t points : {1000, 100000, 1000000}) {
+        std::vector<double> ys(points);
+        for(auto& y : ys) {
+            y = dist(rng);
+        }
+
+        OffscreenPlot plot;
+        plot.initShaders();
+        auto ds = std::make_shared<DataSet>();
+        ds->addDataWithoutX(ys.begin(), ys.end());
+        plot.addDataSet(ds);
+
+        runner.run("render/renderScene/" + std::to_string(points), points, [&plot, &opt]() {
+            plot.renderScene(opt.width, opt.height);
+            glFinish();
+        });
+    }
+
+    //raw points are uploaded once, every frame switches between amplitude and phase
+    std::uniform_int_distribution<int> part(-128, 127);
+    for(size_t points : {100000, 1000000}) {
+        std::vector<std::pair<int16_t, int16_t>> raw(points);
+        for(auto& p : raw) {
+            p = {static_cast<int16_t>(part(rng)), static_cast<int16_t>(part(rng))};
+        }
+
+        OffscreenPlot plot;
+        plot.initShaders();
+        auto ds = std::make_shared<DataSet>();
+        ds->addRawData(raw.begin(), raw.end());
+        plot.addDataSet(ds);
+
+        bool phase = false;
+        runner.run("render/renderScene/raw_switch/" + std::to_string(points), points, [&plot, &opt, &ds, &phase]() {
+            phase = !phase;
+            ds->setRawView(phase ? DataSet::RawView::Phase : DataSet::RawView::Amplitude);
+            plot.renderScene(opt.width, opt.height);
+            glFinish();
+        });
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if(!parseOptions(argc, argv, opt))
+        return 1;
+
+    BenchRunner runner(opt.runner);
+
+    decodeBenchmarks(runner, opt);
+    preprocessBenchmarks(runner, opt);
+    dataSetBenchmarks(runner, opt);
+    renderBenchmarks(runner, opt);     //shaders are read from the current directory
+
+    //DB_Handler opens database.db in the working directory, so every run
+    //starts from an empty database inside the scratch directory
+    std::filesystem::path originalDir = std::filesystem::current_path();
+    std::filesystem::create_directories(opt.workdir);
+    std::filesystem::current_path(opt.workdir);
+    std::filesystem::remove("database.db");
+    databaseBenchmarks(runner, opt);
+    std::filesystem::current_path(originalDir);
+
+    nlohmann::json report;
+    report["context"] = {
+        {"date", std::time(nullptr)},
+        {"compiler", __VERSION__},
+        {"packets", opt.packets},
+        {"seed", opt.seed},
+        {"min_time", opt.runner.minTime}
+    };
+    report["benchmarks"] = runner.getResults();
+
+    if(opt.out.empty()) {
+        std::cout << report.dump(4) << std::endl;
+    }
+    else {
+        std::ofstream out(opt.out);
+        out << report.dump(4) << std::endl;
+    }
+    return 0;
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <limits>
+#include <utility>
 #include <vector>
 #include <sigc++/sigc++.h>
 #include <gdkmm/rgba.h>
@@ -16,8 +21,23 @@ public:
     };
 
 
+    //what a set of raw points shows, see addRawPoint()
+    enum class RawView {
+        Amplitude,
+        Phase
+    };
+
+    //x is the index of the point
     void addDataPoint(double y) {
-        addDataPoint(extr.maxX + 1, y);
+        fromRaw();
+        if(implicitX) {
+            addY(y);
+            revision++;
+            signalChanged.emit(*this);
+        }
+        else {
+            addDataPoint(getNumberOfPoints() ? extr.maxX + 1 : 0, y);
+        }
     }
 
     void addDataPoint(double x, double y);
@@ -27,31 +47,81 @@ public:
     //see specializations
     template <typename Iterator>    //iterators must point to pair<x, y>
     void addData(Iterator begin, Iterator end) {
+        toExplicitX();
         bool toSort = false;
         for(Iterator it = begin; it != end; ++it) {
             toSort = toSort || it->first < extr.maxX;
             addPoint(it->first, it->second);
         }
-        if(toSort) {
+        if(toSort && !isWindowed()) {
             sort();
         }
 
+        revision++;
         signalChanged.emit(*this);
     }
 
+    //x is the index of the point, points of a set that has explicit x get x from 0
     template <typename Iterator>
     void addDataWithoutX(Iterator begin, Iterator end) {
-        bool toSort = false;
-        size_t x = 0;
-        for(Iterator it = begin; it != end; ++it, x++) {
-            addPoint(x, *it);
+        fromRaw();
+        if(implicitX) {
+            for(Iterator it = begin; it != end; ++it) {
+                addY(*it);
+            }
+        }
+        else {
+            size_t x = 0;
+            for(Iterator it = begin; it != end; ++it, x++) {
+                addPoint(x, *it);
+            }
         }
 
+        revision++;
         signalChanged.emit(*this);
     }
 
+    //A set keeps the real and imaginary parts as they are while all its points
+    //were added this way, x is the index of the point. Amplitude or phase is
+    //computed by the plot shader, so setRawView() doesn't touch the points.
+    //A raw point added to a set that has values is added as its value
+    void addRawPoint(int16_t re, int16_t im);
+
+    template <typename Iterator>    //iterators must point to pair<re, im>
+    void addRawData(Iterator begin, Iterator end) {
+        if(takesRaw()) {
+            for(Iterator it = begin; it != end; ++it) {
+                addRaw(it->first, it->second);
+            }
+        }
+        else {
+            for(Iterator it = begin; it != end; ++it) {
+                addValue(rawValue(it->first, it->second));
+            }
+        }
+        revision++;
+        signalChanged.emit(*this);
+    }
+
+    bool isRaw() const;
+    void setRawView(RawView view);
+    RawView getRawView() const;
+
+    //changes whenever the points change, but not with the view, color or visibility
+    uint64_t getRevision() const;
+
     void clear();
 
+    //Keeps only the last maxPoints points and, if maxSpanX isn't 0, only the
+    //points within maxSpanX of the last x. Memory stays constant and a point
+    //costs O(1), so it suits live data. Points are expected in x order, they
+    //aren't sorted in this mode. maxPoints = 0 turns the window off.
+    //x of implicit-x and raw series is the point index, so for them maxSpanX
+    //is a number of points, a time span has to be converted by the caller.
+    //Current points are dropped
+    void setWindow(size_t maxPoints, double maxSpanX = 0);
+    bool isWindowed() const;
+
     sigc::signal<void(DataSet&)> signalOnChanged() const;
 
     size_t getNumberOfPoints() const;
@@ -62,7 +132,17 @@ public:
     void setColor(Gdk::RGBA color);
     Gdk::RGBA getColor();
 
+    //A set keeps only y while all its points were added without x, x of a
+    //point is then getFirstX() plus its index in the buffer. The first point
+    //with an explicit x switches the set to x, y pairs until clear()
+    bool hasImplicitX() const;
+    double getFirstX() const;
+
+    //points as x, y pairs or only y, see hasImplicitX()
     const double* getFirstElementAddress() const;
+    //re, im pairs of a raw set, see isRaw()
+    const int16_t* getFirstRawAddress() const;
+    //size of the points in bytes
     size_t getSizeOfBuffer() const;
     Extrems getExtremums() const;
 
@@ -77,6 +157,79 @@ private:
 
     sigc::signal<void(DataSet&)> signalChanged;
 
-    std::vector<double> points; //contains points as double x, double y, double x, double y...
+    std::vector<double> points; //contains points as double x, double y, double x, double y... or only y
+    bool implicitX = true;
+
+    size_t stride() const {
+        return implicitX ? 1 : 2;
+    }
+
+    void addY(double y);
+    void toExplicitX();
+
+    std::vector<int16_t> rawPoints;     //re, im, re, im... of a raw set, a ring like points in the window mode
+    bool raw = false;
+    RawView rawView = RawView::Amplitude;
+    double minSquaredAmpl = std::numeric_limits<double>::max();     //of a raw set without window
+    double maxSquaredAmpl = std::numeric_limits<double>::lowest();
+    uint64_t revision = 0;
+
+    bool takesRaw();
+    double rawValue(int16_t re, int16_t im) const;
+    void addRaw(int16_t re, int16_t im);
+    void addValue(double y);
+    void fromRaw();
+    void updateRawExtremums(double minSquared, double maxSquared);
+
+    //min or max of the values of a sliding window, amortized O(1) per value
+    template<typename Compare>
+    class SlidingExtremum {
+    public:
+        void push(uint64_t seq, double val) {
+            while(!values.empty() && !Compare()(values.back().second, val))
+                values.pop_back();
+            values.emplace_back(seq, val);
+        }
+
+        //drops values older than firstSeq
+        void evict(uint64_t firstSeq) {
+            while(!values.empty() && values.front().first < firstSeq)
+                values.pop_front();
+        }
+
+        bool empty() const {
+            return values.empty();
+        }
+
+        double get() const {
+            return values.front().second;
+        }
+
+        void clear() {
+            values.clear();
+        }
+
+    private:
+        std::deque<std::pair<uint64_t, double>> values;     //(seq, value), the extremum in front
+    };
+
+    //In the window mode points is a ring of capacity points stored twice,
+    //point i is kept at i and at i + capacity. The window is then always
+    //contiguous, starting at head, and is uploaded to the GPU as it is.
+    //With implicit x a point's x is its sequence number, a raw set tracks
+    //the squared amplitude in windowMaxY and windowMinY
+    size_t capacity = 0;
+    double maxSpanX = 0;
+    size_t head = 0;
+    size_t count = 0;
+    uint64_t nextSeq = 0;   //sequence number of the next point, the oldest one is nextSeq - count
+    SlidingExtremum<std::greater<double>> windowMaxX;
+    SlidingExtremum<std::less<double>> windowMinX;
+    SlidingExtremum<std::greater<double>> windowMaxY;
+    SlidingExtremum<std::less<double>> windowMinY;
+
+    void addWindowPoint(double x, double y);
+    void dropOldest();
+    void updateWindowExtremums();
 
 };
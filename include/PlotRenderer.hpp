@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Shader.hpp"
+#include "DataSet.hpp"
+
+#include <cairomm/cairomm.h>
+#include <gdkmm/rgba.h>
+#include <map>
+#include <memory>
+#include <vector>
+#include <limits>
+
+//Draws datasets with OpenGL into whatever framebuffer is currently bound.
+//Doesn't depend on a widget, so it can render into an offscreen context
+//as well as into a Gtk::GLArea
+class PlotRenderer {
+public:
+
+    virtual ~PlotRenderer() = default;
+
+    void initShaders();
+
+    //context must be current and shaders initialized
+    void renderScene(size_t width, size_t height);
+
+protected:
+
+    const size_t left_reserve = 250;
+    const size_t right_reserve = 20;
+    const size_t up_reserve = 20;
+    const size_t down_reserve = 100;
+
+    double maxX = std::numeric_limits<double>::lowest();
+    double minX = std::numeric_limits<double>::max();
+    double maxY = std::numeric_limits<double>::lowest();
+    double minY = std::numeric_limits<double>::max();
+    std::vector<std::shared_ptr<DataSet>> datasets;
+
+    Shader shader;
+    Shader implicitXShader;     //for datasets without x, see DataSet::hasImplicitX()
+    Shader rawShader;           //computes amplitude or phase, see DataSet::isRaw()
+    Shader textureShader;
+
+    void updateExtremums();
+
+    struct EdgePositions {
+        double up;
+        double right;
+        double down;
+        double left;
+    };
+
+    struct OpenglDSBuffers {    //RAII wrapper for OpenGL buffers for datasets
+        unsigned int VBO;
+        unsigned int VAO;
+        size_t size;        //bytes of the storage, it can't be resized
+        bool raw;
+        bool implicitX;
+
+        OpenglDSBuffers(const DataSet& dataSet);
+
+        //uploads the points into the existing storage, false if the size or layout changed
+        bool update(const DataSet& dataSet);
+
+        void enable();
+        void disable();
+
+        ~OpenglDSBuffers();
+
+    };
+
+    //buffers are uploaded again only when points of the dataset change,
+    //into the same storage while its size stays (a full live window)
+    struct CachedDSBuffers {
+        uint64_t revision = 0;
+        std::unique_ptr<OpenglDSBuffers> buffers;
+    };
+    std::map<const DataSet*, CachedDSBuffers> dsBuffers;
+
+    OpenglDSBuffers& buffersOf(const DataSet& data);
+
+    struct OpenglCairoBuffer {      //RAII wrapper for OpenGL buffers for Cairo drawing
+        unsigned int VBO;
+        unsigned int VAO;
+        unsigned int texture;
+
+        OpenglCairoBuffer(const Cairo::ImageSurface& surface);
+
+        void enable();
+        void disable();
+
+        ~OpenglCairoBuffer();
+    };
+
+    void drawDataSet(const DataSet& data, Gdk::RGBA color, EdgePositions edgePos);
+
+    void drawLegend(size_t windowWidth, size_t windowHeight, EdgePositions pos);
+};
@@ -9,6 +9,11 @@ public:
 
     Shader(const char* vertShaderProg, const char* fragShaderProg);
 
+    //Same program, loaded from the program binary cache if it has one built
+    //by the current driver. Otherwise it's compiled from the sources and
+    //stored there. The cache lives in $XDG_CACHE_HOME/db_collector/shaders
+    static Shader cached(const char* vertShaderProg, const char* fragShaderProg);
+
     Shader(const Shader& other) = default;
 
     Shader& operator=(const Shader& other) = default;
@@ -20,6 +25,8 @@ public:
     ~Shader() = default;
 
 private:
+    explicit Shader(unsigned int program);
+
     std::shared_ptr<unsigned int> id;
     bool isOk = false;
 
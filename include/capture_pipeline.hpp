@@ -0,0 +1,261 @@
+#pragma once
+
+#include "experiments_list.hpp"
+#include "frame_bus.hpp"
+#include "metrics.hpp"
+#include "profiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <pthread.h>
+#include <sched.h>
+
+//Receive, preprocess and store stages of capture without any UI.
+//
+//collect() and store() are single steps shared with the GTK pipeline,
+//collect() also publishes frames into the live frame bus if it's enabled.
+//start() runs them on a thread of its own: frames are written in
+//transactions of up to batch frames, a transaction is committed when it is
+//full, after flushMs or when no frame came for a while. All database work of the
+//experiment (marker changes, flushes) must happen on that thread, so other
+//threads post() it and it's run between transactions.
+class CapturePipeline {
+public:
+
+    struct Settings {
+        int cpu = -1;               //core to pin the capture thread to, -1 leaves it free
+        size_t batch = 256;         //frames per transaction
+        unsigned flushMs = 100;     //commit at least this often while frames come
+    };
+
+    using Frame = CapturedFrame;
+
+    //tries to receive one frame and passes it through the preprocessor
+    static std::optional<Frame> collect(ReceiverHandler& recv, PreprocessingHandler* preproc) {
+        Metrics& metrics = Metrics::getInstance();
+        uint64_t collectStart = Metrics::now();
+        auto mbData = recv.tryCollect();
+        if(!mbData)
+            return std::nullopt;
+        metrics.record(Metrics::Stage::Collect, collectStart);
+        PROFILE_ZONE("collect");
+
+        Frame frame{std::move(*mbData), recv.getLastFrameInfo()};
+        if(preproc != nullptr) {
+            PROFILE_ZONE("preprocess");
+            Metrics::ScopedTimer timer(Metrics::Stage::Preprocess);
+            auto mbProcessedData = preproc->process(frame.data, frame.info);
+            if(!mbProcessedData)
+                return std::nullopt;
+            frame.data = std::move(*mbProcessedData);
+        }
+        if(FrameBus::Writer* bus = frameBus())
+            publish(*bus, frame);
+        return frame;
+    }
+
+    //live frame bus of the process, created on first use if DBC_FRAME_BUS is set
+    static FrameBus::Writer* frameBus() {
+        static std::unique_ptr<FrameBus::Writer> bus = []() -> std::unique_ptr<FrameBus::Writer> {
+            auto settings = FrameBus::Writer::settingsFromEnv();
+            return settings ? FrameBus::Writer::create(*settings) : nullptr;
+        }();
+        return bus.get();
+    }
+
+    //writes the frame into the bus in the FlatFrame stream order, frames that aren't rectangular are skipped
+    static void publish(FrameBus::Writer& bus, const Frame& frame) {
+        PROFILE_ZONE("publish");
+        const auto& re = frame.data.first;
+        const auto& im = frame.data.second;
+        FrameBus::FrameMeta meta;
+        meta.nr = re.size();
+        meta.nc = meta.nr ? re[0].size() : 0;
+        meta.ns = meta.nc ? re[0][0].size() : 0;
+        if(im.size() != meta.nr || meta.values() == 0)
+            return;
+        for(size_t r = 0; r < meta.nr; r++) {
+            if(re[r].size() != meta.nc || im[r].size() != meta.nc)
+                return;
+            for(size_t c = 0; c < meta.nc; c++) {
+                if(re[r][c].size() != meta.ns || im[r][c].size() != meta.ns)
+                    return;
+            }
+        }
+        meta.hostNs = frame.info.hostNs;
+        meta.tsf = frame.info.hwTimestamp;
+        meta.sourceId = frame.info.sourceId;
+        meta.rssi = frame.info.rssi;
+        meta.noise = frame.info.noise;
+        std::copy(frame.info.chainRssi.begin(), frame.info.chainRssi.end(), meta.chainRssi);
+
+        bus.publish(meta, [&re, &im, &meta](float* dstRe, float* dstIm) {
+            for(size_t r = 0; r < meta.nr; r++) {
+                for(size_t c = 0; c < meta.nc; c++) {
+                    dstRe = std::copy(re[r][c].begin(), re[r][c].end(), dstRe);
+                    dstIm = std::copy(im[r][c].begin(), im[r][c].end(), dstIm);
+                }
+            }
+        });
+    }
+
+    static void store(Experiment& exp, const Frame& frame) {
+        {
+            PROFILE_ZONE("addPoint");
+            Metrics::ScopedTimer timer(Metrics::Stage::AddPoint);
+            exp.addPoint(frame.data, frame.info);
+        }
+        Metrics::getInstance().add(Metrics::Counter::Stored);
+    }
+
+    CapturePipeline() = default;
+
+    ~CapturePipeline() {
+        stop();
+    }
+
+    CapturePipeline(const CapturePipeline&) = delete;
+    CapturePipeline& operator=(const CapturePipeline&) = delete;
+
+    //exp, recv and preproc must outlive the pipeline
+    void start(Experiment& exp, ReceiverHandler& recv, PreprocessingHandler* preproc, Settings newSettings) {
+        stop();
+        settings = newSettings;
+        worker = std::jthread([this, &exp, &recv, preproc](std::stop_token stoken) {
+            work(stoken, exp, recv, preproc);
+        });
+    }
+
+    void stop() {
+        if(worker.joinable()) {
+            worker.request_stop();
+            worker.join();
+        }
+    }
+
+    bool isRunning() const {
+        return worker.joinable() && !finished;
+    }
+
+    //runs task on the capture thread outside of a transaction
+    void post(std::function<void()> task) {
+        std::lock_guard lock(tasksMutex);
+        tasks.push_back(std::move(task));
+    }
+
+    //frames are still received while paused, but thrown away
+    void setPaused(bool val) {
+        paused = val;
+    }
+
+    bool isPaused() const {
+        return paused;
+    }
+
+private:
+    static constexpr unsigned idleSpins = 64;   //empty receives before the thread starts to sleep
+
+    Settings settings;
+    std::jthread worker;
+    std::atomic<bool> paused = false;
+    std::atomic<bool> finished = false;
+    std::mutex tasksMutex;
+    std::deque<std::function<void()>> tasks;
+
+    void pin() {
+        if(settings.cpu < 0)
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(settings.cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(err != 0)
+            std::cerr << "CapturePipeline: unable to pin the capture thread to cpu " << settings.cpu << ": " << std::strerror(err) << std::endl;
+    }
+
+    void runTasks() {
+        std::deque<std::function<void()>> toRun;
+        {
+            std::lock_guard lock(tasksMutex);
+            toRun.swap(tasks);
+        }
+        for(auto& task : toRun) {
+            try {
+                task();
+            }
+            catch(const std::exception& ex) {
+                std::cerr << "CapturePipeline: posted task failed: " << ex.what() << std::endl;
+            }
+        }
+    }
+
+    void work(std::stop_token stoken, Experiment& exp, ReceiverHandler& recv, PreprocessingHandler* preproc) {
+        using clock = std::chrono::steady_clock;
+        pin();
+        finished = false;
+
+        SQLite::Database& db = DB_Handler::get_db();
+        std::optional<SQLite::Transaction> transaction;
+        size_t inTransaction = 0;
+        auto transactionStart = clock::now();
+        unsigned idleRounds = 0;
+
+        auto commit = [&]() {
+            if(!transaction)
+                return;
+            transaction->commit();
+            transaction.reset();
+            inTransaction = 0;
+            Metrics::getInstance().set(Metrics::Gauge::WriteQueue, 0);
+        };
+
+        try {
+            while(!stoken.stop_requested()) {
+                auto frame = collect(recv, preproc);
+                if(!frame || paused) {
+                    //a short spin first, then the batch is committed and the thread sleeps up to a millisecond
+                    if(++idleRounds > idleSpins || clock::now() - transactionStart >= std::chrono::milliseconds(settings.flushMs)) {
+                        commit();
+                        runTasks();
+                    }
+                    if(idleRounds > idleSpins)
+                        std::this_thread::sleep_for(std::chrono::microseconds(std::min(idleRounds, 1000u)));
+                    continue;
+                }
+                idleRounds = 0;
+
+                if(!transaction) {
+                    exp.schema(db);     //attaches the shard, which isn't allowed inside a transaction
+                    transaction.emplace(db);
+                    transactionStart = clock::now();
+                }
+                store(exp, *frame);
+                recv.recycle(std::move(frame->data));
+                Metrics::getInstance().set(Metrics::Gauge::WriteQueue, ++inTransaction);
+
+                if(inTransaction >= settings.batch ||
+                   clock::now() - transactionStart >= std::chrono::milliseconds(settings.flushMs))
+                {
+                    commit();
+                    runTasks();
+                }
+            }
+            commit();
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "CapturePipeline: capture stopped: " << ex.what() << std::endl;
+        }
+        transaction.reset();    //rolls back what wasn't committed after an error
+        Metrics::getInstance().set(Metrics::Gauge::WriteQueue, 0);
+        runTasks();
+        finished = true;
+    }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <random>
+#include <cmath>
+
+//Builds datagrams in the same layout that the ath9k CSI tool sends
+//and record_status/fill_csi_matrix expect on a little-endian host:
+//
+//  [0..22]   csi_struct header (tstamp, csi_len, channel, phyerr, noise,
+//            rate, chanBW, num_tones, nr, nc, rssi, rssi_0..rssi_2)
+//  [23..24]  payload_len
+//  [25..]    csi_len bytes of CSI, 10 bit imag/real pairs packed
+//            LSB first, tone is the outer loop and rx the inner one
+//  [..]      payload_len bytes of payload
+//  [last 2]  buf_len
+class CsiPacketEncoder {
+public:
+
+    static constexpr size_t headerLen = 23;   //same as csi_st_len in csi_fun.c
+
+    struct Params {
+        uint8_t nr = 3;
+        uint8_t nc = 3;
+        uint8_t num_tones = 56;
+        uint16_t channel = 2437;
+        uint8_t chanBW = 0;
+        uint8_t rate = 0x80;
+        uint8_t noise = 0;
+        uint8_t rssi = 40;
+        uint16_t payload_len = 1056;          //RouterReceiver drops anything shorter
+    };
+
+    CsiPacketEncoder() = default;
+
+    CsiPacketEncoder(Params params, uint64_t seed = 0) :
+        params(params),
+        rng(seed)
+    {}
+
+    const Params& getParams() const {
+        return params;
+    }
+
+    static size_t csiLength(const Params& p) {
+        size_t bits = static_cast<size_t>(p.nr) * p.nc * p.num_tones * 20;
+        return (bits + 15) / 16 * 2;          //decoder consumes whole 16 bit words
+    }
+
+    size_t datagramLength() const {
+        return headerLen + 2 + csiLength(params) + params.payload_len + 2;
+    }
+
+    //Fills out with a datagram. csi is indexed as [nr][nc][tone] and holds
+    //pairs of (real, imag) in the range of signed 10 bit integers.
+    void encode(std::vector<unsigned char>& out,
+                uint64_t tstamp,
+                const std::vector<std::vector<std::vector<std::pair<int, int>>>>& csi) const
+    {
+        const size_t csiLen = csiLength(params);
+        out.assign(datagramLength(), 0);
+
+        putLE(out, 0, tstamp, 8);
+        putLE(out, 8, csiLen, 2);
+        putLE(out, 10, params.channel, 2);
+        out[12] = 0;                          //phyerr
+        out[13] = params.noise;
+        out[14] = params.rate;
+        out[15] = params.chanBW;
+        out[16] = params.num_tones;
+        out[17] = params.nr;
+        out[18] = params.nc;
+        out[19] = params.rssi;
+        out[20] = params.rssi;
+        out[21] = params.rssi;
+        out[22] = params.rssi;
+        putLE(out, headerLen, params.payload_len, 2);
+
+        unsigned char* csiAddr = out.data() + headerLen + 2;
+        size_t bitPos = 0;
+        auto putBits = [csiAddr, &bitPos](int value) {
+            uint32_t v = static_cast<uint32_t>(value) & 0x3ff;
+            for(int i = 0; i < 10; i++, bitPos++) {
+                if(v & (1u << i))
+                    csiAddr[bitPos / 8] |= static_cast<unsigned char>(1u << (bitPos % 8));
+            }
+        };
+
+        for(size_t k = 0; k < params.num_tones; k++) {
+            for(size_t c = 0; c < params.nc; c++) {
+                for(size_t r = 0; r < params.nr; r++) {
+                    const auto& val = csi.at(r).at(c).at(k);
+                    putBits(val.second);      //imag goes first
+                    putBits(val.first);
+                }
+            }
+        }
+
+        size_t payloadStart = headerLen + 2 + csiLen;
+        for(size_t i = 0; i < params.payload_len; i++) {
+            out[payloadStart + i] = static_cast<unsigned char>(i);
+        }
+
+        putLE(out, out.size() - 2, out.size() - 2, 2);
+    }
+
+    //Generates a plausible CSI matrix: per link a smooth amplitude profile
+    //across subcarriers with a slowly rotating phase and some noise.
+    void encodeSynthetic(std::vector<unsigned char>& out, uint64_t tstamp, double time) {
+        csiBuf.resize(params.nr);
+        std::normal_distribution<double> noise(0.0, 6.0);
+        for(size_t r = 0; r < params.nr; r++) {
+            csiBuf[r].resize(params.nc);
+            for(size_t c = 0; c < params.nc; c++) {
+                csiBuf[r][c].resize(params.num_tones);
+                for(size_t k = 0; k < params.num_tones; k++) {
+                    double ampl = 200.0 + 120.0 * std::sin(0.11 * k + 0.7 * r + 0.3 * c + 0.5 * time);
+                    double phase = 0.05 * k + 2.0 * time + r - c;
+                    csiBuf[r][c][k] = {clamp10(ampl * std::cos(phase) + noise(rng)),
+                                       clamp10(ampl * std::sin(phase) + noise(rng))};
+                }
+            }
+        }
+        encode(out, tstamp, csiBuf);
+    }
+
+private:
+    Params params;
+    std::mt19937_64 rng;
+    std::vector<std::vector<std::vector<std::pair<int, int>>>> csiBuf;
+
+    static int clamp10(double v) {
+        if(v > 511) return 511;
+        if(v < -512) return -512;
+        return static_cast<int>(std::lround(v));
+    }
+
+    static void putLE(std::vector<unsigned char>& out, size_t pos, uint64_t value, size_t bytes) {
+        for(size_t i = 0; i < bytes; i++) {
+            out[pos + i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+    }
+};
@@ -51,6 +51,7 @@ bool  is_big_endian();
 int   open_csi_device();
 void  close_csi_device(int fd);
 int   read_csi_buf(unsigned char* buf_addr,int fd, int BUFSIZE);
+void  fill_csi_matrix(u_int8_t* csi_addr, int nr, int nc, int num_tones, COMPLEX(* csi_matrix)[3][114]);
 void  record_status(unsigned char* buf_addr, int cnt, csi_struct* csi_status);
 void  record_csi_payload(unsigned char* buf_addr, csi_struct* csi_status,unsigned char* data_buf, COMPLEX(* csi_buf)[3][114]);
 void  porcess_csi(unsigned char* data_buf, csi_struct* csi_status,COMPLEX(* csi_buf)[3][114]);
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+#include "handler_base.hpp"
+
+//Parser of ath9k CSI tool datagrams (layout is described in csi_encoder.hpp),
+//used instead of record_status/record_csi_payload from csi_fun.c.
+//
+//parse() checks once that the header, the CSI described by it and the
+//payload fit into the datagram and returns a view over the caller's buffer,
+//nothing is copied. decode() writes CSI values straight into a frame,
+//reusing its vectors when the shape doesn't change.
+//Multibyte fields are little-endian, as record_status reads them on
+//little-endian hosts.
+//
+//The usual 3x3x56 (20 MHz) and 3x3x114 (40 MHz) captures are decoded by
+//FixedDecoder instantiations, other shapes by the generic bit reader.
+namespace CsiParser {
+
+constexpr size_t headerLen = 23;            //csi_st_len in csi_fun.c
+constexpr size_t csiOffset = headerLen + 2; //after payload_len
+constexpr unsigned valueBits = 10;
+
+struct Header {
+    uint64_t tstamp = 0;
+    uint16_t csiLen = 0;
+    uint16_t channel = 0;
+    uint8_t phyerr = 0;
+    uint8_t noise = 0;
+    uint8_t rate = 0;
+    uint8_t chanBW = 0;
+    uint8_t numTones = 0;
+    uint8_t nr = 0;
+    uint8_t nc = 0;
+    uint8_t rssi = 0;
+    uint8_t rssi0 = 0;
+    uint8_t rssi1 = 0;
+    uint8_t rssi2 = 0;
+    uint16_t payloadLen = 0;
+    uint16_t bufLen = 0;
+};
+
+inline uint64_t readLE(const unsigned char* p, size_t bytes) {
+    uint64_t value = 0;
+    for(size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline int signExtend(uint32_t value) {
+    return static_cast<int>(value ^ (1u << (valueBits - 1))) - (1 << (valueBits - 1));
+}
+
+//bytes of CSI the decoder reads, it consumes whole 16 bit words
+inline size_t csiBytes(size_t nr, size_t nc, size_t tones) {
+    return (nr * nc * tones * valueBits * 2 + 15) / 16 * 2;
+}
+
+//resizes frame to [nr][nc][tones] keeping the allocated memory
+inline void shapeFrame(HandlerBase::datatype& frame, size_t nr, size_t nc, size_t tones) {
+    for(auto* part : {&frame.first, &frame.second}) {
+        part->resize(nr);
+        for(auto& rx : *part) {
+            rx.resize(nc);
+            for(auto& tx : rx) {
+                tx.resize(tones);
+            }
+        }
+    }
+}
+
+//Decoder for one (nr, nc, tones) shape known at compile time.
+//A block of one or two tones ends at a byte boundary, so the byte offset
+//and the shift of every value inside a block are constants. Each value is
+//taken from an unaligned 8 byte load and stored straight into its stream,
+//the block is fully unrolled over its values. The last load reads up to
+//readBytes from the start of CSI, a few bytes past it.
+template<size_t NR, size_t NC, size_t TONES>
+struct FixedDecoder {
+    static constexpr size_t links = NR * NC;
+    static constexpr size_t tonesPerBlock = links % 2 ? 2 : 1;
+    static constexpr size_t valuesPerBlock = links * tonesPerBlock;
+    static constexpr size_t blockBytes = valuesPerBlock * valueBits * 2 / 8;
+    static constexpr size_t blocks = TONES / tonesPerBlock;
+    static constexpr size_t readBytes = (blocks - 1) * blockBytes + (valuesPerBlock - 1) * valueBits * 2 / 8 + 8;
+    static_assert(TONES % tonesPerBlock == 0, "tones must fill whole blocks");
+
+    using Streams = std::array<double*, links>;     //rx-minor, as in the datagram
+
+    static void decode(const unsigned char* src, HandlerBase::datatype& frame) {
+        shapeFrame(frame, NR, NC, TONES);
+        Streams re, im;
+        for(size_t c = 0; c < NC; c++) {
+            for(size_t r = 0; r < NR; r++) {
+                re[c * NR + r] = frame.first[r][c].data();
+                im[c * NR + r] = frame.second[r][c].data();
+            }
+        }
+        for(size_t b = 0; b < blocks; b++) {
+            decodeBlock(src + b * blockBytes, b * tonesPerBlock, re, im, std::make_index_sequence<valuesPerBlock>());
+        }
+    }
+
+private:
+    template<size_t... J>
+    static void decodeBlock(const unsigned char* src, size_t k, const Streams& re, const Streams& im, std::index_sequence<J...>) {
+        (decodeValue<J>(src, k, re, im), ...);
+    }
+
+    template<size_t J>
+    static void decodeValue(const unsigned char* src, size_t k, const Streams& re, const Streams& im) {
+        constexpr size_t bit = J * valueBits * 2;
+        constexpr unsigned shift = bit % 8;
+        uint64_t w;
+        std::memcpy(&w, src + bit / 8, sizeof(w));
+        if constexpr(std::endian::native == std::endian::big)
+            w = __builtin_bswap64(w);
+        im[J % links][k + J / links] = extract(w >> shift);
+        re[J % links][k + J / links] = extract(w >> (shift + valueBits));
+    }
+
+    //sign extends the low 10 bits
+    static int extract(uint64_t w) {
+        return static_cast<int16_t>(static_cast<uint16_t>(w << (16 - valueBits))) >> (16 - valueBits);
+    }
+};
+
+class Datagram {
+public:
+
+    static std::optional<Datagram> parse(std::span<const unsigned char> bytes) {
+        if(bytes.size() < csiOffset + 2)
+            return std::nullopt;
+
+        Datagram d;
+        d.bytes = bytes;
+        const unsigned char* p = bytes.data();
+        Header& h = d.head;
+        h.tstamp = readLE(p, 8);
+        h.csiLen = readLE(p + 8, 2);
+        h.channel = readLE(p + 10, 2);
+        h.phyerr = p[12];
+        h.noise = p[13];
+        h.rate = p[14];
+        h.chanBW = p[15];
+        h.numTones = p[16];
+        h.nr = p[17];
+        h.nc = p[18];
+        h.rssi = p[19];
+        h.rssi0 = p[20];
+        h.rssi1 = p[21];
+        h.rssi2 = p[22];
+        h.payloadLen = readLE(p + headerLen, 2);
+        h.bufLen = readLE(p + bytes.size() - 2, 2);
+
+        if(csiBytes(h.nr, h.nc, h.numTones) > h.csiLen)
+            return std::nullopt;
+        if(csiOffset + static_cast<size_t>(h.csiLen) + h.payloadLen > bytes.size())
+            return std::nullopt;
+        return d;
+    }
+
+    const Header& header() const {
+        return head;
+    }
+
+    std::span<const unsigned char> csi() const {
+        return bytes.subspan(csiOffset, head.csiLen);
+    }
+
+    //payload of the frame, points into the datagram
+    std::span<const unsigned char> payload() const {
+        return bytes.subspan(csiOffset + head.csiLen, head.payloadLen);
+    }
+
+    //Decodes CSI of the first nr x nc antennas and tones subcarriers into
+    //frame, real parts go to first and imaginary ones to second.
+    //Whole frames of the common shapes go to the specialized decoders
+    void decode(HandlerBase::datatype& frame, size_t nr, size_t nc, size_t tones) const {
+        const bool whole = nr >= head.nr && nc >= head.nc && tones >= head.numTones;
+        if(whole && head.nr == 3 && head.nc == 3) {
+            if(head.numTones == 56 && tryFixed<3, 3, 56>(frame))
+                return;
+            if(head.numTones == 114 && tryFixed<3, 3, 114>(frame))
+                return;
+        }
+        decodeGeneric(frame, nr, nc, tones);
+    }
+
+    //Values are stored tone by tone, tx by tx, rx by rx, imaginary part first
+    void decodeGeneric(HandlerBase::datatype& frame, size_t nr, size_t nc, size_t tones) const {
+        nr = std::min<size_t>(nr, head.nr);
+        nc = std::min<size_t>(nc, head.nc);
+        tones = std::min<size_t>(tones, head.numTones);
+        shapeFrame(frame, nr, nc, tones);
+
+        const unsigned char* src = bytes.data() + csiOffset;
+        uint64_t bitBuf = 0;
+        unsigned bitsLeft = 0;
+        auto next = [&src, &bitBuf, &bitsLeft]() {
+            if(bitsLeft < valueBits) {
+                bitBuf |= readLE(src, 2) << bitsLeft;
+                src += 2;
+                bitsLeft += 16;
+            }
+            int value = signExtend(bitBuf & ((1u << valueBits) - 1));
+            bitBuf >>= valueBits;
+            bitsLeft -= valueBits;
+            return value;
+        };
+
+        for(size_t k = 0; k < tones; k++) {
+            for(size_t c = 0; c < head.nc; c++) {
+                for(size_t r = 0; r < head.nr; r++) {
+                    int imag = next();
+                    int real = next();
+                    if(r < nr && c < nc) {
+                        frame.first[r][c][k] = real;
+                        frame.second[r][c][k] = imag;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    std::span<const unsigned char> bytes;
+
+    template<size_t NR, size_t NC, size_t TONES>
+    bool tryFixed(HandlerBase::datatype& frame) const {
+        if(csiOffset + FixedDecoder<NR, NC, TONES>::readBytes > bytes.size())
+            return false;
+        FixedDecoder<NR, NC, TONES>::decode(bytes.data() + csiOffset, frame);
+        return true;
+    }
+
+    Header head;
+};
+
+}
@@ -2,24 +2,33 @@
 #include <filesystem>
 #include <string>
 #include <cstdio>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <SQLiteCpp/SQLiteCpp.h>
 #include <sqlite3.h>
-
-extern "C" void pre_hook(
-    void *pCtx,                   /* Copy of third arg to preupdate_hook() */
-    int op,                       /* SQLITE_UPDATE, DELETE or INSERT */
-    char const *zDb,              /* Database name */
-    char const *zName,            /* Table name */
-    sqlite3_int64 iKey1           /* Rowid of row about to be deleted/updated */
-    );
+#include "sql_qualify.hpp"
+#include "rollups.hpp"
+#include "experiment_stats.hpp"
+#include "marker_segments.hpp"
+#include "packet_time.hpp"
 
 class DB_Handler {
 public:
     static constexpr const std::string database_path = "database.db";
+    static constexpr int schema_version = 8;    //PRAGMA user_version after all migrations
+    static constexpr int shard_schema_version = 5;
+    static constexpr size_t max_attached_shards = 8;  //SQLite allows 10 attached databases by default
+    static constexpr const char* shards_dir = "shards";
+    static constexpr int busy_timeout_ms = 5000;
 
     static SQLite::Database& get_db() {
         struct Opener {
             bool applySQL = false;
+            bool migrated = false;
             SQLite::Database db;
             Opener() :
                 applySQL(!std::filesystem::exists(std::filesystem::path{database_path})),
@@ -27,10 +36,12 @@ public:
             {
                 db.exec("PRAGMA synchronous=OFF;");
                 db.exec("PRAGMA count_changes=OFF;");
-                db.exec("PRAGMA journal_mode=MEMORY;");
+                db.exec("PRAGMA journal_mode=WAL;");    //reads of other connections don't block writes
                 db.exec("PRAGMA temp_store=MEMORY;");
+                if(applySQL)
+                    db.exec("PRAGMA auto_vacuum = INCREMENTAL;");  //only possible before the first table
                 db.exec("PRAGMA foreign_keys = ON;");
-                sqlite3_update_hook(db.getHandle(), pre_hook, NULL);
+                db.setBusyTimeout(busy_timeout_ms);
             }
         };
         static Opener opener;
@@ -105,26 +116,385 @@ public:
             opener.db.exec(schema_sql);
             opener.applySQL = false;
         }
+        if(!opener.migrated) {
+            opener.migrated = true;
+            migrate(opener.db);
+        }
         return opener.db;
     }
-};
 
-extern "C" void pre_hook(
-    void *pCtx,                   /* Copy of third arg to preupdate_hook() */
-    int op,                       /* SQLITE_UPDATE, DELETE or INSERT */
-    char const *zDb,              /* Database name */
-    char const *zName,            /* Table name */
-    sqlite3_int64 iKey1           /* Rowid of row about to be deleted/updated */
-)
-{
-    if(op != SQLITE_DELETE || std::string(zName) != std::string("image"))
-        return;
+    //Separate connection for background threads, the main one is used by the UI thread only
+    static std::unique_ptr<SQLite::Database> open_worker_connection() {
+        get_db();   //makes sure the schema exists and is migrated
+        auto db = std::make_unique<SQLite::Database>(database_path, SQLite::OPEN_READWRITE);
+        db->exec("PRAGMA synchronous=OFF;");
+        db->exec("PRAGMA temp_store=MEMORY;");
+        db->exec("PRAGMA foreign_keys = ON;");
+        db->setBusyTimeout(busy_timeout_ms);
+        return db;
+    }
+
+    //Creates an empty shard file for an experiment and returns its path
+    static std::string create_shard(int32_t expId) {
+        std::filesystem::create_directories(shards_dir);
+        std::string path = (std::filesystem::path(shards_dir) / ("experiment_" + std::to_string(expId) + ".db")).string();
+        std::filesystem::remove(path);
+        SQLite::Database shard(path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        shard.exec("PRAGMA auto_vacuum = INCREMENTAL;");
+        shard.exec("PRAGMA journal_mode=WAL;");
+        migrate_shard(shard);
+        return path;
+    }
+
+    //Attaches the shard of an experiment to db unless it's attached already and
+    //returns the schema name to use in queries. Every connection keeps at most
+    //max_attached_shards shards, the least recently used one is detached first.
+    //ATTACH isn't allowed inside a transaction, so the first access to a shard
+    //mustn't happen in one, it throws otherwise
+    static std::string attach_shard(SQLite::Database& db, int32_t expId, const std::string& path) {
+        const std::string schema = "shard_" + std::to_string(expId);
+        std::lock_guard lock(shards_mutex());
+        std::list<int32_t>& attached = attached_shards()[db.getHandle()];
+        for(auto it = attached.begin(); it != attached.end(); ++it) {
+            if(*it == expId) {
+                attached.splice(attached.begin(), attached, it);
+                return schema;
+            }
+        }
+
+        if(!sqlite3_get_autocommit(db.getHandle())) {
+            throw std::runtime_error("Shard of experiment " + std::to_string(expId) +
+                                     " must be attached before a transaction is started");
+        }
+
+        if(attached.size() >= max_attached_shards) {
+            db.exec("DETACH DATABASE shard_" + std::to_string(attached.back()));
+            attached.pop_back();
+        }
+
+        {
+            SQLite::Database shard(path, SQLite::OPEN_READWRITE);
+            migrate_shard(shard);
+        }
+        SQLite::Statement attach(db, "ATTACH DATABASE @path AS " + schema);
+        attach.bind("@path", path);
+        attach.exec();
+        attached.push_front(expId);
+        return schema;
+    }
+
+    static void detach_shard(SQLite::Database& db, int32_t expId) {
+        std::lock_guard lock(shards_mutex());
+        std::list<int32_t>& attached = attached_shards()[db.getHandle()];
+        for(auto it = attached.begin(); it != attached.end(); ++it) {
+            if(*it == expId) {
+                db.exec("DETACH DATABASE shard_" + std::to_string(expId));
+                attached.erase(it);
+                return;
+            }
+        }
+    }
+
+    //must be called before a worker connection is closed
+    static void forget_connection(SQLite::Database& db) {
+        std::lock_guard lock(shards_mutex());
+        attached_shards().erase(db.getHandle());
+    }
+
+private:
+    static std::mutex& shards_mutex() {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::map<sqlite3*, std::list<int32_t>>& attached_shards() {
+        static std::map<sqlite3*, std::list<int32_t>> shards;
+        return shards;
+    }
+
+    //Shards hold packet, measurement, processed_measurement, measurement_rollup,
+    //marker, marker_segment, time_base and tsf_base of a single experiment, with the same columns as in the main database
+    //but without foreign keys to the catalog tables
+    static void migrate_shard(SQLite::Database& db) {
+        int version = db.execAndGet("PRAGMA user_version").getInt();
+        if(version < 1) {
+            SQLite::Transaction transaction(db);
+            db.exec(R"asdasd(
+            CREATE TABLE IF NOT EXISTS "packet" (
+                "id"	INTEGER NOT NULL,
+                "marker"	TEXT,
+                "timestamp"	INTEGER,
+                "experiment_id"	INTEGER NOT NULL,
+                PRIMARY KEY("id" AUTOINCREMENT)
+            );
+            CREATE TABLE IF NOT EXISTS "measurement" (
+                "id"	INTEGER NOT NULL,
+                "id_packet"	INTEGER NOT NULL,
+                "num_sub"	INTEGER NOT NULL,
+                "rx"	INTEGER NOT NULL,
+                "tx"	INTEGER NOT NULL,
+                "real_part"	INTEGER NOT NULL,
+                "imag_part"	INTEGER NOT NULL,
+                FOREIGN KEY("id_packet") REFERENCES "packet"("id") ON DELETE CASCADE,
+                PRIMARY KEY("id" AUTOINCREMENT)
+            );
+            CREATE TABLE IF NOT EXISTS "processed_measurement" (
+                "id"	INTEGER NOT NULL,
+                "id_measurement"	INTEGER NOT NULL,
+                "amplitude"	REAL NOT NULL,
+                "phase"	REAL NOT NULL,
+                PRIMARY KEY("id" AUTOINCREMENT),
+                FOREIGN KEY("id_measurement") REFERENCES "measurement"("id") ON DELETE CASCADE
+            );
+            CREATE TRIGGER IF NOT EXISTS process_measurement
+            AFTER INSERT
+            ON measurement
+            BEGIN
+                INSERT INTO processed_measurement (id_measurement, amplitude, phase)
+                VALUES (NEW.id, SQRT(NEW.real_part * NEW.real_part + NEW.imag_part * NEW.imag_part), atan2(NEW.imag_part, NEW.real_part));
+            END;
+            CREATE TABLE IF NOT EXISTS "measurement_rollup" (
+                "experiment_id"	INTEGER NOT NULL,
+                "rx"	INTEGER NOT NULL,
+                "tx"	INTEGER NOT NULL,
+                "num_sub"	INTEGER NOT NULL,
+                "level"	INTEGER NOT NULL,
+                "bucket"	INTEGER NOT NULL,
+                "count"	INTEGER NOT NULL,
+                "ampl_min"	REAL NOT NULL,
+                "ampl_max"	REAL NOT NULL,
+                "ampl_sum"	REAL NOT NULL,
+                "phase_min"	REAL NOT NULL,
+                "phase_max"	REAL NOT NULL,
+                "phase_sum"	REAL NOT NULL,
+                PRIMARY KEY("experiment_id", "rx", "tx", "num_sub", "level", "bucket")
+            ) WITHOUT ROWID;
+            CREATE INDEX IF NOT EXISTS "packet_experiment_timestamp" ON "packet" ("experiment_id", "timestamp");
+            CREATE INDEX IF NOT EXISTS "measurement_packet" ON "measurement" ("id_packet");
+            CREATE INDEX IF NOT EXISTS "processed_measurement_measurement" ON "processed_measurement" ("id_measurement");
+            )asdasd");
+            db.exec("PRAGMA user_version = 1");
+            transaction.commit();
+        }
+        if(version < 2) {
+            SQLite::Transaction transaction(db);
+            db.exec(R"asdasd(
+            CREATE TABLE IF NOT EXISTS "marker" (
+                "id"	INTEGER NOT NULL,
+                "text"	TEXT NOT NULL UNIQUE,
+                PRIMARY KEY("id" AUTOINCREMENT)
+            );
+            ALTER TABLE "packet" ADD COLUMN "marker_id" INTEGER REFERENCES "marker"("id");
+            CREATE TABLE IF NOT EXISTS "marker_segment" (
+                "experiment_id"	INTEGER NOT NULL,
+                "marker_id"	INTEGER NOT NULL,
+                "first_packet"	INTEGER NOT NULL,
+                "last_packet"	INTEGER NOT NULL,
+                PRIMARY KEY("experiment_id", "first_packet"),
+                FOREIGN KEY("marker_id") REFERENCES "marker"("id")
+            ) WITHOUT ROWID;
+            )asdasd");
+            SQLite::Statement experiments(db, "SELECT DISTINCT experiment_id FROM packet");
+            while(experiments.executeStep()) {
+                MarkerSegments::rebuild(db, experiments.getColumn(0).getInt());
+            }
+            db.exec("PRAGMA user_version = 2");
+            transaction.commit();
+        }
+        if(version < 3) {
+            SQLite::Transaction transaction(db);
+            db.exec(R"asdasd(
+            ALTER TABLE "packet" ADD COLUMN "host_ns_off" INTEGER;
+            ALTER TABLE "packet" ADD COLUMN "tsf_off" INTEGER;
+            CREATE INDEX IF NOT EXISTS "packet_experiment_host_ns" ON "packet" ("experiment_id", "host_ns_off");
+            CREATE TABLE IF NOT EXISTS "time_base" (
+                "experiment_id"	INTEGER NOT NULL,
+                "host_ns"	INTEGER NOT NULL,
+                "tsf"	INTEGER,
+                PRIMARY KEY("experiment_id")
+            );
+            )asdasd");
+            SQLite::Statement experiments(db, "SELECT DISTINCT experiment_id FROM packet");
+            while(experiments.executeStep()) {
+                PacketTime::backfill(db, experiments.getColumn(0).getInt());
+            }
+            db.exec("PRAGMA user_version = 3");
+            transaction.commit();
+        }
+        if(version < 4) {
+            SQLite::Transaction transaction(db);
+            db.exec(R"asdasd(ALTER TABLE "packet" ADD COLUMN "source_id" INTEGER NOT NULL DEFAULT 0;)asdasd");
+            db.exec("PRAGMA user_version = 4");
+            transaction.commit();
+        }
+        if(version < 5) {
+            SQLite::Transaction transaction(db);
+            db.exec(R"asdasd(
+            CREATE TABLE IF NOT EXISTS "tsf_base" (
+                "experiment_id"	INTEGER NOT NULL,
+                "source_id"	INTEGER NOT NULL,
+                "tsf"	INTEGER NOT NULL,
+                PRIMARY KEY("experiment_id", "source_id")
+            ) WITHOUT ROWID;
+            )asdasd");
+            PacketTime::splitTsfBase(db);
+            db.exec("PRAGMA user_version = 5");
+            transaction.commit();
+        }
+    }
+
+    //Brings databases created by older versions up to schema_version,
+    //every step runs in its own transaction and bumps user_version
+    static void migrate(SQLite::Database& db) {
+        int version = db.execAndGet("PRAGMA user_version").getInt();
+        if(version > schema_version) {
+            std::cerr << "Database schema version " << version << " is newer than supported " << schema_version << std::endl;
+            return;
+        }
 
-    SQLite::Database& db = DB_Handler::get_db();
-    SQLite::Statement query(db, "SELECT image_path FROM image WHERE id=@id");
-    query.bind("@id", static_cast<int64_t>(iKey1));
-    if(!query.executeStep())
-        return;
-    std::string filePath = query.getColumn(0);
-    std::remove(filePath.c_str());
-}
+        try {
+            if(version < 1) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(
+                CREATE INDEX IF NOT EXISTS "packet_experiment_timestamp" ON "packet" ("experiment_id", "timestamp");
+                CREATE INDEX IF NOT EXISTS "measurement_packet" ON "measurement" ("id_packet");
+                CREATE INDEX IF NOT EXISTS "processed_measurement_measurement" ON "processed_measurement" ("id_measurement");
+                CREATE TABLE IF NOT EXISTS "measurement_rollup" (
+                    "experiment_id"	INTEGER NOT NULL,
+                    "rx"	INTEGER NOT NULL,
+                    "tx"	INTEGER NOT NULL,
+                    "num_sub"	INTEGER NOT NULL,
+                    "level"	INTEGER NOT NULL,
+                    "bucket"	INTEGER NOT NULL,
+                    "count"	INTEGER NOT NULL,
+                    "ampl_min"	REAL NOT NULL,
+                    "ampl_max"	REAL NOT NULL,
+                    "ampl_sum"	REAL NOT NULL,
+                    "phase_min"	REAL NOT NULL,
+                    "phase_max"	REAL NOT NULL,
+                    "phase_sum"	REAL NOT NULL,
+                    PRIMARY KEY("experiment_id", "rx", "tx", "num_sub", "level", "bucket"),
+                    FOREIGN KEY("experiment_id") REFERENCES "experiment"("id") ON DELETE CASCADE
+                ) WITHOUT ROWID;
+                )asdasd");
+                SQLite::Statement experiments(db, "SELECT id FROM experiment");
+                while(experiments.executeStep()) {
+                    Rollups::rebuild(db, experiments.getColumn(0).getInt());
+                }
+                db.exec("PRAGMA user_version = 1");
+                transaction.commit();
+            }
+            if(version < 2) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(
+                CREATE TABLE IF NOT EXISTS "experiment_stats" (
+                    "experiment_id"	INTEGER NOT NULL,
+                    "packet_count"	INTEGER NOT NULL DEFAULT 0,
+                    "photo_count"	INTEGER NOT NULL DEFAULT 0,
+                    "first_timestamp"	INTEGER,
+                    "last_timestamp"	INTEGER,
+                    "rx_count"	INTEGER NOT NULL DEFAULT 0,
+                    "tx_count"	INTEGER NOT NULL DEFAULT 0,
+                    "sub_count"	INTEGER NOT NULL DEFAULT 0,
+                    "measurement_count"	INTEGER NOT NULL DEFAULT 0,
+                    "bytes_used"	INTEGER NOT NULL DEFAULT 0,
+                    PRIMARY KEY("experiment_id"),
+                    FOREIGN KEY("experiment_id") REFERENCES "experiment"("id") ON DELETE CASCADE
+                );
+                CREATE INDEX IF NOT EXISTS "experiment_stats_first" ON "experiment_stats" ("first_timestamp");
+                CREATE INDEX IF NOT EXISTS "experiment_stats_last" ON "experiment_stats" ("last_timestamp");
+                CREATE INDEX IF NOT EXISTS "image_experiment" ON "image" ("experiment_id");
+                )asdasd");
+                SQLite::Statement experiments(db, "SELECT id FROM experiment");
+                while(experiments.executeStep()) {
+                    ExperimentStats::rebuild(db, experiments.getColumn(0).getInt());
+                }
+                db.exec("PRAGMA user_version = 2");
+                transaction.commit();
+            }
+            if(version < 3) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(ALTER TABLE "experiment" ADD COLUMN "deleting" INTEGER NOT NULL DEFAULT 0;)asdasd");
+                db.exec("PRAGMA user_version = 3");
+                transaction.commit();
+            }
+            if(version < 4) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(ALTER TABLE "experiment" ADD COLUMN "shard_path" TEXT;)asdasd");
+                db.exec("PRAGMA user_version = 4");
+                transaction.commit();
+            }
+            if(version < 5) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(
+                CREATE TABLE IF NOT EXISTS "marker" (
+                    "id"	INTEGER NOT NULL,
+                    "text"	TEXT NOT NULL UNIQUE,
+                    PRIMARY KEY("id" AUTOINCREMENT)
+                );
+                ALTER TABLE "packet" ADD COLUMN "marker_id" INTEGER REFERENCES "marker"("id");
+                CREATE TABLE IF NOT EXISTS "marker_segment" (
+                    "experiment_id"	INTEGER NOT NULL,
+                    "marker_id"	INTEGER NOT NULL,
+                    "first_packet"	INTEGER NOT NULL,
+                    "last_packet"	INTEGER NOT NULL,
+                    PRIMARY KEY("experiment_id", "first_packet"),
+                    FOREIGN KEY("experiment_id") REFERENCES "experiment"("id") ON DELETE CASCADE,
+                    FOREIGN KEY("marker_id") REFERENCES "marker"("id")
+                ) WITHOUT ROWID;
+                )asdasd");
+                SQLite::Statement experiments(db, "SELECT id FROM experiment WHERE shard_path IS NULL");
+                while(experiments.executeStep()) {
+                    MarkerSegments::rebuild(db, experiments.getColumn(0).getInt());
+                }
+                db.exec("PRAGMA user_version = 5");
+                transaction.commit();
+            }
+            if(version < 6) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(
+                ALTER TABLE "packet" ADD COLUMN "host_ns_off" INTEGER;
+                ALTER TABLE "packet" ADD COLUMN "tsf_off" INTEGER;
+                CREATE INDEX IF NOT EXISTS "packet_experiment_host_ns" ON "packet" ("experiment_id", "host_ns_off");
+                CREATE TABLE IF NOT EXISTS "time_base" (
+                    "experiment_id"	INTEGER NOT NULL,
+                    "host_ns"	INTEGER NOT NULL,
+                    "tsf"	INTEGER,
+                    PRIMARY KEY("experiment_id"),
+                    FOREIGN KEY("experiment_id") REFERENCES "experiment"("id") ON DELETE CASCADE
+                );
+                )asdasd");
+                SQLite::Statement experiments(db, "SELECT id FROM experiment WHERE shard_path IS NULL");
+                while(experiments.executeStep()) {
+                    PacketTime::backfill(db, experiments.getColumn(0).getInt());
+                }
+                db.exec("PRAGMA user_version = 6");
+                transaction.commit();
+            }
+            if(version < 7) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(ALTER TABLE "packet" ADD COLUMN "source_id" INTEGER NOT NULL DEFAULT 0;)asdasd");
+                db.exec("PRAGMA user_version = 7");
+                transaction.commit();
+            }
+            if(version < 8) {
+                SQLite::Transaction transaction(db);
+                db.exec(R"asdasd(
+                CREATE TABLE IF NOT EXISTS "tsf_base" (
+                    "experiment_id"	INTEGER NOT NULL,
+                    "source_id"	INTEGER NOT NULL,
+                    "tsf"	INTEGER NOT NULL,
+                    PRIMARY KEY("experiment_id", "source_id"),
+                    FOREIGN KEY("experiment_id") REFERENCES "experiment"("id") ON DELETE CASCADE
+                ) WITHOUT ROWID;
+                )asdasd");
+                PacketTime::splitTsfBase(db);
+                db.exec("PRAGMA user_version = 8");
+                transaction.commit();
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "Database migration failed: " << ex.what() << std::endl;
+        }
+    }
+};
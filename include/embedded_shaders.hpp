@@ -0,0 +1,93 @@
+#pragma once
+
+//Generated by tools/embed_shaders.sh from the *.glsl files, don't edit.
+
+namespace EmbeddedShaders {
+
+inline constexpr const char* FragShader = R"glsl(#version 460
+
+out vec4 FragColor;
+
+uniform vec4 color;
+
+void main() {
+   FragColor = color;
+}
+)glsl";
+
+inline constexpr const char* TextureFragShader = R"glsl(#version 460
+
+out vec4 FragColor;
+in vec2 TexCoord;
+
+uniform sampler2D ourTexture;
+
+void main() {
+    FragColor = texture(ourTexture, TexCoord);
+}
+)glsl";
+
+inline constexpr const char* TextureVertShader = R"glsl(#version 460
+
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+out vec2 TexCoord;
+
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    TexCoord = aTexCoord;
+}
+)glsl";
+
+inline constexpr const char* VertShader = R"glsl(#version 460
+
+layout(location = 0) in vec2 aPos;
+
+uniform double xMult;
+uniform double xShift;
+uniform double yMult;
+uniform double yShift;
+
+void main() {
+   gl_Position = vec4(0, 0, 0, 1);
+   gl_Position = vec4(aPos.x * xMult + xShift, aPos.y * yMult + yShift, 0.0, 1.0);
+}
+)glsl";
+
+inline constexpr const char* VertShaderImplicitX = R"glsl(#version 460
+
+layout(location = 0) in float aY;
+
+uniform double xOffset;
+uniform double xMult;
+uniform double xShift;
+uniform double yMult;
+uniform double yShift;
+
+void main() {
+   double x = double(gl_VertexID) + xOffset;
+   gl_Position = vec4(x * xMult + xShift, aY * yMult + yShift, 0.0, 1.0);
+}
+)glsl";
+
+inline constexpr const char* VertShaderRaw = R"glsl(#version 460
+
+layout(location = 0) in vec2 aRaw;     //real and imaginary parts
+
+uniform bool phase;
+uniform double xOffset;
+uniform double xMult;
+uniform double xShift;
+uniform double yMult;
+uniform double yShift;
+
+void main() {
+   double x = double(gl_VertexID) + xOffset;
+   //atan is undefined for 0, 0 while atan2 gives 0
+   double y = phase ? (aRaw == vec2(0.0) ? 0.0 : atan(aRaw.y, aRaw.x)) : length(aRaw);
+   gl_Position = vec4(x * xMult + xShift, y * yMult + yShift, 0.0, 1.0);
+}
+)glsl";
+
+} // namespace EmbeddedShaders
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "db_handler.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glibmm/dispatcher.h>
+#include <sigc++/sigc++.h>
+
+//Deletes experiments in the background.
+//
+//enqueue() only marks the experiment with experiment.deleting = 1, so it
+//disappears from the list at once. A worker thread with its own connection
+//then removes packets in small transactions (measurements go with them by
+//cascade), so the UI connection is blocked for one chunk at most. Image
+//files are collected first and unlinked only after their rows are gone.
+//Experiments kept in a shard database skip the chunks, the catalog rows are
+//removed and the shard file is unlinked.
+//Experiments still marked on startup are picked up again by resumePending().
+//Progress and completion are delivered in the UI thread through a Dispatcher,
+//so getInstance() has to be called from the UI thread first.
+class ExperimentDeleter {
+public:
+    static constexpr int packetsPerChunk = 64;
+    static constexpr int vacuumPagesPerStep = 256;
+
+    static ExperimentDeleter& getInstance() {
+        static ExperimentDeleter inst;
+        return inst;
+    }
+
+    void enqueue(int32_t expId) {
+        SQLite::Statement mark(DB_Handler::get_db(), "UPDATE experiment SET deleting = 1 WHERE id = @id");
+        mark.bind("@id", expId);
+        mark.exec();
+        push({expId});
+    }
+
+    void resumePending() {
+        SQLite::Statement query(DB_Handler::get_db(), "SELECT id FROM experiment WHERE deleting = 1");
+        std::vector<int32_t> ids;
+        while(query.executeStep()) {
+            ids.push_back(query.getColumn(0).getInt());
+        }
+        if(!ids.empty())
+            push(ids);
+    }
+
+    bool isBusy() const {
+        return busy.load();
+    }
+
+    //fraction of the current experiment and how many experiments are waiting after it
+    sigc::signal<void(double, size_t)> signalProgress() const {
+        return _signalProgress;
+    }
+
+    sigc::signal<void(int32_t)> signalDeleted() const {
+        return _signalDeleted;
+    }
+
+    ~ExperimentDeleter() {
+        if(worker.joinable()) {
+            worker.request_stop();
+            worker.join();
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable_any queueChanged;
+    std::deque<int32_t> queue;
+    std::jthread worker;
+    std::atomic<bool> busy = false;
+
+    //written by the worker, read by the dispatcher handlers
+    std::atomic<double> progress = 0;
+    std::atomic<size_t> waiting = 0;
+    std::vector<int32_t> deleted;
+
+    Glib::Dispatcher progressDispatcher;
+    Glib::Dispatcher deletedDispatcher;
+    sigc::signal<void(double, size_t)> _signalProgress;
+    sigc::signal<void(int32_t)> _signalDeleted;
+
+    ExperimentDeleter() {
+        progressDispatcher.connect([this]() {
+            _signalProgress.emit(progress.load(), waiting.load());
+        });
+        deletedDispatcher.connect([this]() {
+            std::vector<int32_t> ids;
+            {
+                std::lock_guard lock(mutex);
+                ids.swap(deleted);
+            }
+            for(int32_t id : ids)
+                _signalDeleted.emit(id);
+        });
+    }
+
+    void push(const std::vector<int32_t>& ids) {
+        {
+            std::lock_guard lock(mutex);
+            queue.insert(queue.end(), ids.begin(), ids.end());
+            busy = true;
+        }
+        if(!worker.joinable())
+            worker = std::jthread([this](std::stop_token stoken) { work(stoken); });
+        queueChanged.notify_one();
+    }
+
+    void work(std::stop_token stoken) {
+        std::unique_ptr<SQLite::Database> db;
+        try {
+            db = DB_Handler::open_worker_connection();
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "ExperimentDeleter: unable to open database: " << ex.what() << std::endl;
+            return;
+        }
+
+        while(!stoken.stop_requested()) {
+            int32_t expId;
+            {
+                std::unique_lock lock(mutex);
+                if(!queueChanged.wait(lock, stoken, [this]() { return !queue.empty(); })) {
+                    DB_Handler::forget_connection(*db);
+                    return;
+                }
+                expId = queue.front();
+                queue.pop_front();
+                waiting = queue.size();
+            }
+
+            try {
+                if(deleteExperiment(*db, expId, stoken)) {
+                    std::lock_guard lock(mutex);
+                    deleted.push_back(expId);
+                }
+                deletedDispatcher.emit();
+
+                bool idle;
+                {
+                    std::lock_guard lock(mutex);
+                    idle = queue.empty();
+                }
+                if(idle)
+                    vacuum(*db, stoken);
+            }
+            catch(const std::exception& ex) {
+                std::cerr << "ExperimentDeleter: failed to delete experiment " << expId << ": " << ex.what() << std::endl;
+            }
+
+            std::lock_guard lock(mutex);
+            if(queue.empty())
+                busy = false;
+        }
+        DB_Handler::forget_connection(*db);
+    }
+
+    bool deleteExperiment(SQLite::Database& db, int32_t expId, std::stop_token& stoken) {
+        std::vector<std::string> files;
+        SQLite::Statement images(db, "SELECT image_path FROM image WHERE experiment_id = @id");
+        images.bind("@id", expId);
+        while(images.executeStep()) {
+            files.push_back(images.getColumn(0).getString());
+        }
+
+        std::optional<std::string> shardPath;
+        SQLite::Statement shard(db, "SELECT shard_path FROM experiment WHERE id = @id");
+        shard.bind("@id", expId);
+        if(shard.executeStep() && !shard.getColumn(0).isNull())
+            shardPath = shard.getColumn(0).getString();
+        if(shardPath)
+            return deleteShardedExperiment(db, expId, *shardPath, files);
+
+        int64_t total = 0;
+        SQLite::Statement count(db, "SELECT COUNT(1) FROM packet WHERE experiment_id = @id");
+        count.bind("@id", expId);
+        if(count.executeStep())
+            total = count.getColumn(0).getInt64();
+
+        SQLite::Statement chunk(db, R"asd(
+            DELETE FROM packet WHERE id IN (
+                SELECT id FROM packet WHERE experiment_id = @id LIMIT @limit
+            )
+        )asd");
+        int64_t removed = 0;
+        while(true) {
+            if(stoken.stop_requested())
+                return false;       //the mark stays, resumed on the next start
+            int changes;
+            {
+                SQLite::Transaction transaction(db);
+                chunk.bind("@id", expId);
+                chunk.bind("@limit", packetsPerChunk);
+                changes = chunk.exec();
+                chunk.reset();
+                transaction.commit();
+            }
+            if(changes == 0)
+                break;
+            removed += changes;
+            progress = total ? std::min(1.0, static_cast<double>(removed) / total) : 1.0;
+            progressDispatcher.emit();
+        }
+
+        deleteCatalogRows(db, expId, files);
+        return true;
+    }
+
+    bool deleteShardedExperiment(SQLite::Database& db, int32_t expId, const std::string& shardPath,
+                                 const std::vector<std::string>& files)
+    {
+        DB_Handler::detach_shard(db, expId);
+        deleteCatalogRows(db, expId, files);
+
+        std::error_code ec;
+        if(!std::filesystem::remove(shardPath, ec) && ec)
+            std::cerr << "Failed to delete shard " << shardPath << ": " << ec.message() << std::endl;
+        progress = 1.0;
+        progressDispatcher.emit();
+        return true;
+    }
+
+    void deleteCatalogRows(SQLite::Database& db, int32_t expId, const std::vector<std::string>& files) {
+        {
+            SQLite::Transaction transaction(db);
+            SQLite::Statement deleteImages(db, "DELETE FROM image WHERE experiment_id = @id");
+            deleteImages.bind("@id", expId);
+            deleteImages.exec();
+            SQLite::Statement deleteExp(db, "DELETE FROM experiment WHERE id = @id");
+            deleteExp.bind("@id", expId);
+            deleteExp.exec();
+            transaction.commit();
+        }
+
+        for(const std::string& file : files) {
+            std::error_code ec;
+            if(!std::filesystem::remove(std::filesystem::path("images") / file, ec) && ec)
+                std::cerr << "Failed to delete file " << file << ": " << ec.message() << std::endl;
+        }
+    }
+
+    //returns freed pages to the filesystem, works only for databases created with auto_vacuum
+    void vacuum(SQLite::Database& db, std::stop_token& stoken) {
+        if(db.execAndGet("PRAGMA auto_vacuum").getInt() != 2)
+            return;
+        while(!stoken.stop_requested() && db.execAndGet("PRAGMA freelist_count").getInt() > 0) {
+            db.exec("PRAGMA incremental_vacuum(" + std::to_string(vacuumPagesPerStep) + ")");
+        }
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <SQLiteCpp/SQLiteCpp.h>
+#include "sql_qualify.hpp"
+
+//Per-experiment totals kept in experiment_stats, so the info panel and the
+//list filters read one row instead of scanning packet and image tables.
+//The row is updated by Experiment::addPoint/addPhoto as data comes in and
+//recomputed by rebuild() for data inserted in bulk (migration, import).
+//bytes_used is an estimate: rows are counted with fixed sizes plus marker
+//text left in packet rows by older versions, photos with their file sizes.
+namespace ExperimentStats {
+
+constexpr int64_t packetRowBytes = 40;          //packet row and its index entries
+constexpr int64_t measurementRowBytes = 80;     //measurement and processed_measurement rows with indexes
+
+struct Stats {
+    uint32_t packets = 0;
+    uint32_t photos = 0;
+    std::optional<int64_t> firstTimestamp;
+    std::optional<int64_t> lastTimestamp;
+    uint32_t rx = 0;
+    uint32_t tx = 0;
+    uint32_t subcarriers = 0;
+    uint64_t measurements = 0;
+    uint64_t bytesUsed = 0;
+};
+
+inline Stats load(SQLite::Database& db, int32_t expId) {
+    Stats stats;
+    SQLite::Statement query(db, R"asd(
+        SELECT packet_count, photo_count, first_timestamp, last_timestamp,
+               rx_count, tx_count, sub_count, measurement_count, bytes_used
+        FROM experiment_stats WHERE experiment_id = @exp_id
+    )asd");
+    query.bind("@exp_id", expId);
+    if(!query.executeStep())
+        return stats;
+    stats.packets = query.getColumn(0).getUInt();
+    stats.photos = query.getColumn(1).getUInt();
+    if(!query.getColumn(2).isNull())
+        stats.firstTimestamp = query.getColumn(2).getInt64();
+    if(!query.getColumn(3).isNull())
+        stats.lastTimestamp = query.getColumn(3).getInt64();
+    stats.rx = query.getColumn(4).getUInt();
+    stats.tx = query.getColumn(5).getUInt();
+    stats.subcarriers = query.getColumn(6).getUInt();
+    stats.measurements = query.getColumn(7).getInt64();
+    stats.bytesUsed = query.getColumn(8).getInt64();
+    return stats;
+}
+
+inline void addPacket(SQLite::Database& db, int32_t expId, int64_t timestamp, uint32_t rx, uint32_t tx, uint32_t subcarriers,
+                      uint64_t measurements)
+{
+    SQLite::Statement query(db, R"asd(
+        INSERT INTO experiment_stats (experiment_id, packet_count, first_timestamp, last_timestamp,
+                                      rx_count, tx_count, sub_count, measurement_count, bytes_used)
+        VALUES (@exp_id, 1, @time, @time, @rx, @tx, @sub, @meas, @bytes)
+        ON CONFLICT (experiment_id) DO UPDATE SET
+            packet_count = packet_count + 1,
+            first_timestamp = MIN(COALESCE(first_timestamp, excluded.first_timestamp), excluded.first_timestamp),
+            last_timestamp = MAX(COALESCE(last_timestamp, excluded.last_timestamp), excluded.last_timestamp),
+            rx_count = MAX(rx_count, excluded.rx_count),
+            tx_count = MAX(tx_count, excluded.tx_count),
+            sub_count = MAX(sub_count, excluded.sub_count),
+            measurement_count = measurement_count + excluded.measurement_count,
+            bytes_used = bytes_used + excluded.bytes_used
+    )asd");
+    query.bind("@exp_id", expId);
+    query.bind("@time", timestamp);
+    query.bind("@rx", rx);
+    query.bind("@tx", tx);
+    query.bind("@sub", subcarriers);
+    query.bind("@meas", static_cast<int64_t>(measurements));
+    query.bind("@bytes", static_cast<int64_t>(packetRowBytes + measurements * measurementRowBytes));
+    query.exec();
+}
+
+inline void addPhoto(SQLite::Database& db, int32_t expId, uint64_t fileBytes) {
+    SQLite::Statement query(db, R"asd(
+        INSERT INTO experiment_stats (experiment_id, photo_count, bytes_used)
+        VALUES (@exp_id, 1, @bytes)
+        ON CONFLICT (experiment_id) DO UPDATE SET
+            photo_count = photo_count + 1,
+            bytes_used = bytes_used + excluded.bytes_used
+    )asd");
+    query.bind("@exp_id", expId);
+    query.bind("@bytes", static_cast<int64_t>(fileBytes));
+    query.exec();
+}
+
+//schema holds packets and measurements of the experiment, see qualifySql
+inline void rebuild(SQLite::Database& db, int32_t expId, const std::string& schema = "main") {
+    SQLite::Statement query(db, qualifySql(R"asd(
+        INSERT OR REPLACE INTO experiment_stats (experiment_id, packet_count, photo_count, first_timestamp, last_timestamp,
+                                                 rx_count, tx_count, sub_count, measurement_count, bytes_used)
+        SELECT @exp_id, p.cnt, (SELECT COUNT(1) FROM image WHERE experiment_id = @exp_id), p.first, p.last,
+               COALESCE(m.rx, 0), COALESCE(m.tx, 0), COALESCE(m.sub, 0), m.cnt,
+               p.cnt * @packet_bytes + COALESCE(p.markers, 0) + m.cnt * @meas_bytes
+        FROM (SELECT COUNT(1) AS cnt, MIN(timestamp) AS first, MAX(timestamp) AS last, SUM(LENGTH(marker)) AS markers
+              FROM data.packet WHERE experiment_id = @exp_id) AS p,
+             (SELECT MAX(rx) + 1 AS rx, MAX(tx) + 1 AS tx, MAX(num_sub) + 1 AS sub, COUNT(1) AS cnt
+              FROM data.measurement JOIN data.packet ON measurement.id_packet = packet.id
+              WHERE packet.experiment_id = @exp_id) AS m
+    )asd", schema));
+    query.bind("@exp_id", expId);
+    query.bind("@packet_bytes", packetRowBytes);
+    query.bind("@meas_bytes", measurementRowBytes);
+    query.exec();
+
+    int64_t photoBytes = 0;
+    SQLite::Statement images(db, "SELECT image_path FROM image WHERE experiment_id = @exp_id");
+    images.bind("@exp_id", expId);
+    while(images.executeStep()) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(std::filesystem::path("images") / images.getColumn(0).getString(), ec);
+        if(!ec)
+            photoBytes += size;
+    }
+    SQLite::Statement addBytes(db, "UPDATE experiment_stats SET bytes_used = bytes_used + @bytes WHERE experiment_id = @exp_id");
+    addBytes.bind("@bytes", photoBytes);
+    addBytes.bind("@exp_id", expId);
+    addBytes.exec();
+}
+
+}
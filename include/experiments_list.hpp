@@ -1,17 +1,24 @@
 #pragma once
 #include "db_handler.hpp"
+#include "experiment_deleter.hpp"
+#include "query_executor.hpp"
 #include "handlers_list.hpp"
 #include "hw_list.hpp"
 #include <map>
 #include <vector>
 #include <map>
+#include <memory>
+#include <limits>
+#include <algorithm>
 #include <optional>
 #include <nlohmann/json.hpp>
 #include <sigc++/sigc++.h>
+#include <glibmm/main.h>
 #include <cstdio>
 #include <opencv2/opencv.hpp>
 #include <fstream>
 #include "marker_manager.hpp"
+#include "profiler.hpp"
 
 class ExperimentsList;
 
@@ -25,6 +32,216 @@ struct FullExperimentConfig {
     nlohmann::json config;
 };
 
+//Where the packets of an experiment are kept and the read queries over them.
+//It's a plain value, so a copy can be handed to another thread and used
+//with the connection of that thread (see QueryExecutor)
+struct ExperimentData {
+    int32_t id = -1;
+    std::string shardPath;      //empty if the data is kept in the main database
+    bool rawCsi = false;        //stored values are integer CSI as received, see Experiment::storesRawCsi()
+
+    //schema with packets and measurements of the experiment, attaches the shard if needed
+    std::string schema(SQLite::Database& db) const {
+        if(shardPath.empty())
+            return "main";
+        return DB_Handler::attach_shard(db, id, shardPath);
+    }
+
+    //first and last packet timestamps, unix seconds
+    std::optional<std::pair<int64_t, int64_t>> getTimeRange(SQLite::Database& db) const {
+        SQLite::Statement query(db, qualifySql("SELECT MIN(timestamp), MAX(timestamp) FROM data.packet WHERE experiment_id = @exp_id", schema(db)));
+        query.bind("@exp_id", id);
+        if(!query.executeStep() || query.getColumn(0).isNull())
+            return std::nullopt;
+        return std::make_pair(query.getColumn(0).getInt64(), query.getColumn(1).getInt64());
+    }
+
+    struct Bucket {
+        int64_t from = 0;       //unix seconds, first second of the bucket
+        uint32_t count = 0;     //measurements aggregated, 0 for empty buckets
+        double min = 0;
+        double max = 0;
+        double mean = 0;
+    };
+
+    //Aggregates one stream over [from, to] into at most buckets buckets of equal width.
+    //Reads precomputed rollups, so the cost depends on the number of buckets and
+    //not on the number of packets. Empty buckets are omitted. Rollups still kept
+    //in memory by the experiment aren't seen, see Experiment::flushRollups() and takeRollups()
+    std::vector<Bucket> getPointsBucketed(SQLite::Database& db, uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl,
+                                          int64_t from, int64_t to, size_t buckets) const
+    {
+        std::vector<Bucket> result;
+        if(buckets == 0 || to < from)
+            return result;
+
+        const int64_t width = std::max<int64_t>(1, (to - from + buckets) / buckets);
+        const size_t level = Rollups::levelForWidth(width);
+        const int64_t scale = Rollups::levelScale(level);
+
+        std::string prefix = ampl ? "ampl" : "phase";
+        std::string queryStr = "SELECT (bucket * @scale - @from) / @width AS b, SUM(count), MIN(" + prefix + "_min), MAX(" + prefix + "_max), SUM(" + prefix + "_sum)\n";
+        queryStr += R"asdasd(
+            FROM data.measurement_rollup
+            WHERE experiment_id = @exp_id AND
+                  rx = @rx AND
+                  tx = @tx AND
+                  num_sub = @num_sub AND
+                  level = @level AND
+                  bucket BETWEEN @first AND @last
+            GROUP BY b
+            ORDER BY b
+        )asdasd";
+        SQLite::Statement query(db, qualifySql(queryStr, schema(db)));
+        query.bind("@scale", scale);
+        query.bind("@from", from);
+        query.bind("@width", width);
+        query.bind("@exp_id", id);
+        query.bind("@rx", rx);
+        query.bind("@tx", tx);
+        query.bind("@num_sub", num_sub);
+        query.bind("@level", static_cast<uint32_t>(level));
+        query.bind("@first", from / scale);     //the partial leading bucket too
+        query.bind("@last", to / scale);
+
+        result.reserve(buckets);
+        while(query.executeStep()) {
+            Bucket b;
+            b.from = from + query.getColumn(0).getInt64() * width;
+            b.count = query.getColumn(1).getUInt();
+            b.min = query.getColumn(2).getDouble();
+            b.max = query.getColumn(3).getDouble();
+            b.mean = b.count ? query.getColumn(4).getDouble() / b.count : 0;
+            result.push_back(b);
+        }
+        return result;
+    }
+
+    std::vector<double> getPoints(SQLite::Database& db, uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl) const {
+        std::vector<double> result;
+
+        const std::string dataSchema = schema(db);
+
+        SQLite::Statement infoQuery(db, qualifySql(R"asdasd(
+            SELECT COUNT(packet.id)
+            FROM data.measurement
+            JOIN data.packet ON measurement.id_packet = packet.id
+            WHERE packet.experiment_id = @exp_id
+        )asdasd", dataSchema));
+        infoQuery.bind("@exp_id", id);
+        if(!infoQuery.executeStep()) {
+            std::cerr << "Something wrong on infoQuery in ExperimentData::getPoints" << std::endl;
+            return result;
+        }
+        uint32_t packets_c = infoQuery.getColumn(0);
+        result.reserve(packets_c);
+
+        std::string queryStr = ampl ? "SELECT amplitude\n" : "SELECT phase\n";
+        queryStr += R"asdasd(
+            FROM data.processed_measurement
+            INNER JOIN data.measurement ON id_measurement = measurement.id
+            INNER JOIN data.packet ON measurement.id_packet = packet.id
+            WHERE packet.experiment_id = @exp_id AND
+                  measurement.rx = @rx AND
+                  measurement.tx = @tx AND
+                  measurement.num_sub = @num_sub
+            ORDER BY packet.host_ns_off, packet.id
+        )asdasd";
+        SQLite::Statement query(db, qualifySql(queryStr, dataSchema));
+        query.bind("@exp_id", id);
+        query.bind("@rx", rx);
+        query.bind("@tx", tx);
+        query.bind("@num_sub", num_sub);
+        while(query.executeStep()) {
+            double val = query.getColumn(0);
+            result.push_back(val);
+        }
+        return result;
+    }
+
+    using RawPoint = std::pair<int16_t, int16_t>;   //real and imaginary parts
+
+    //Stored real and imaginary parts of one stream in receive order, the plot
+    //computes amplitude or phase from them itself. Reads only measurement,
+    //values outside of int16 are clamped. Only for rawCsi experiments, output
+    //of preprocessors isn't integer, read it with getPoints()
+    std::vector<RawPoint> getRawPoints(SQLite::Database& db, uint32_t rx, uint32_t tx, uint32_t num_sub) const {
+        std::vector<RawPoint> result;
+        SQLite::Statement query(db, qualifySql(R"asdasd(
+            SELECT measurement.real_part, measurement.imag_part
+            FROM data.packet
+            INNER JOIN data.measurement ON measurement.id_packet = packet.id
+            WHERE packet.experiment_id = @exp_id AND
+                  measurement.rx = @rx AND
+                  measurement.tx = @tx AND
+                  measurement.num_sub = @num_sub
+            ORDER BY packet.host_ns_off, packet.id
+        )asdasd", schema(db)));
+        query.bind("@exp_id", id);
+        query.bind("@rx", rx);
+        query.bind("@tx", tx);
+        query.bind("@num_sub", num_sub);
+        auto toInt16 = [](int val) {
+            return static_cast<int16_t>(std::clamp<int>(val, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max()));
+        };
+        while(query.executeStep())
+            result.emplace_back(toInt16(query.getColumn(0).getInt()), toInt16(query.getColumn(1).getInt()));
+        return result;
+    }
+
+    struct TimedPoint {
+        int64_t hostNs = 0;                 //receive time, ns since epoch
+        std::optional<int64_t> tsf;         //TSF of the NIC of the packet's source, microseconds
+        double value = 0;
+    };
+
+    //Values of one stream received within [fromNs, toNs), in receive order.
+    //Packets are found by the (experiment_id, host_ns_off) index
+    std::vector<TimedPoint> getPointsInWindow(SQLite::Database& db, uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl,
+                                              int64_t fromNs, int64_t toNs) const
+    {
+        std::vector<TimedPoint> result;
+        const std::string dataSchema = schema(db);
+        auto base = PacketTime::load(db, id, dataSchema);
+        if(!base || toNs <= fromNs)
+            return result;
+
+        std::string queryStr = ampl ? "SELECT packet.host_ns_off, packet.tsf_off, packet.source_id, amplitude\n" : "SELECT packet.host_ns_off, packet.tsf_off, packet.source_id, phase\n";
+        queryStr += R"asdasd(
+            FROM data.packet
+            INNER JOIN data.measurement ON measurement.id_packet = packet.id
+            INNER JOIN data.processed_measurement ON processed_measurement.id_measurement = measurement.id
+            WHERE packet.experiment_id = @exp_id AND
+                  packet.host_ns_off >= @from AND packet.host_ns_off < @to AND
+                  measurement.rx = @rx AND
+                  measurement.tx = @tx AND
+                  measurement.num_sub = @num_sub
+            ORDER BY packet.host_ns_off, packet.id
+        )asdasd";
+        SQLite::Statement query(db, qualifySql(queryStr, dataSchema));
+        query.bind("@exp_id", id);
+        query.bind("@from", fromNs - base->hostNs);
+        query.bind("@to", toNs - base->hostNs);
+        query.bind("@rx", rx);
+        query.bind("@tx", tx);
+        query.bind("@num_sub", num_sub);
+        while(query.executeStep()) {
+            TimedPoint point;
+            point.hostNs = base->hostNs + query.getColumn(0).getInt64();
+            auto tsf = base->tsfOf(query.getColumn(2).getInt());
+            if(!query.getColumn(1).isNull() && tsf)
+                point.tsf = *tsf + query.getColumn(1).getInt64();
+            point.value = query.getColumn(3).getDouble();
+            result.push_back(point);
+        }
+        return result;
+    }
+
+    ExperimentStats::Stats getStats(SQLite::Database& db) const {
+        return ExperimentStats::load(db, id);
+    }
+};
+
 class Experiment {
 friend ExperimentsList;
 public:
@@ -90,21 +307,46 @@ public:
         return _updateNameSignal;
     }
 
-    uint32_t addPoint(const HandlerBase::datatype& data) {
+    //info.hostNs is the receive time of the frame, the current time is used if it's unknown
+    uint32_t addPoint(const HandlerBase::datatype& data, const FrameInfo& info = FrameInfo()) {
+        const int64_t hostNs = info.hostNs ? info.hostNs : std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        const int64_t time = hostNs / PacketTime::nsPerSecond;
+
         SQLite::Database& db = DB_Handler::get_db();
-        SQLite::Statement packQuery(db, R"asdasd(
-            INSERT INTO packet (marker, timestamp, experiment_id)
-            VALUES (@marker, unixepoch(), @exp_id)
-        )asdasd");
-        packQuery.bind("@marker", MarkerManager::getInstance().getMarker());
+        const std::string dataSchema = schema(db);
+        //the rows of a packet are written together, in the caller's transaction if there is one
+        std::optional<SQLite::Transaction> transaction;
+        if(sqlite3_get_autocommit(db.getHandle()))
+            transaction.emplace(db);
+        const PacketTime::Base& base = timeBase(db, dataSchema, hostNs, info.sourceId, info.hwTimestamp);
+        if(!markerSegment.isOpen())
+            markerSegment.markerId = MarkerSegments::markerId(db, dataSchema, MarkerManager::getInstance().getMarker());
+        SQLite::Statement packQuery(db, qualifySql(R"asdasd(
+            INSERT INTO data.packet (marker_id, timestamp, host_ns_off, tsf_off, source_id, experiment_id)
+            VALUES (@marker_id, @time, @host_ns_off, @tsf_off, @source_id, @exp_id)
+        )asdasd", dataSchema));
+        packQuery.bind("@marker_id", markerSegment.markerId);
+        packQuery.bind("@time", time);
+        packQuery.bind("@host_ns_off", hostNs - base.hostNs);
+        if(auto tsf = base.tsfOf(info.sourceId); info.hwTimestamp && tsf)
+            packQuery.bind("@tsf_off", static_cast<int64_t>(info.hwTimestamp) - *tsf);
+        else
+            packQuery.bind("@tsf_off");
+        packQuery.bind("@source_id", info.sourceId);
         packQuery.bind("@exp_id", getDBIndex());
         packQuery.exec();
         uint32_t packIdx = db.getLastInsertRowid();
-
-        SQLite::Statement measQuery(db, R"asdasd(
-            INSERT INTO measurement (id_packet, num_sub, rx, tx, real_part, imag_part)
+        if(!markerSegment.isOpen())
+            markerSegment.firstPacket = packIdx;
+        markerSegment.lastPacket = packIdx;
+        //in the transaction of the packet, so packets never outlive their segment after a crash
+        MarkerSegments::write(db, getDBIndex(), dataSchema, markerSegment);
+
+        SQLite::Statement measQuery(db, qualifySql(R"asdasd(
+            INSERT INTO data.measurement (id_packet, num_sub, rx, tx, real_part, imag_part)
             VALUES (@packIdx, @subcar, @rx, @tx, @real, @imag)
-        )asdasd");
+        )asdasd", dataSchema));
         measQuery.bind("@packIdx", packIdx);
         for(uint32_t rx = 0; rx < data.first.size(); rx++) {
             measQuery.bind("@rx", rx);
@@ -119,72 +361,107 @@ public:
                 }
             }
         }
+        rollups.add(db, getDBIndex(), dataSchema, data, time);
+
+        uint32_t rxCount = data.first.size();
+        uint32_t txCount = 0;
+        uint32_t subCount = 0;
+        uint64_t measurements = 0;
+        for(const auto& rx : data.first) {
+            txCount = std::max<uint32_t>(txCount, rx.size());
+            for(const auto& tx : rx) {
+                subCount = std::max<uint32_t>(subCount, tx.size());
+                measurements += tx.size();
+            }
+        }
+        ExperimentStats::addPacket(db, getDBIndex(), time, rxCount, txCount, subCount, measurements);
 
+        if(transaction)
+            transaction->commit();
         return packIdx;
     }
 
-    std::vector<double> getPoints(uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl) const {
-        std::vector<double> result;
-
+    //writes rollups of the last, still open, time buckets
+    void flushRollups() {
         SQLite::Database& db = DB_Handler::get_db();
+        rollups.flush(db, getDBIndex(), schema(db));
+    }
 
-        SQLite::Statement infoQuery(db, R"asdasd(
-            SELECT COUNT(packet.id)
-            FROM measurement
-            JOIN packet ON measurement.id_packet = packet.id
-            WHERE packet.experiment_id = @exp_id
-        )asdasd");
-        infoQuery.bind("@exp_id", getDBIndex());
-        if(!infoQuery.executeStep()) {
-            std::cerr << "Something wrong on infoQuery in Experiment::getPoints" << std::endl;
-            return result;
-        }
-        uint32_t packets_c = infoQuery.getColumn(0);
-        result.reserve(packets_c);
+    //rollups of the still open time buckets, to be written by the caller, e.g. on a worker connection
+    RollupAccumulator takeRollups() {
+        return rollups.take();
+    }
 
-        std::string queryStr = ampl ? "SELECT amplitude\n" : "SELECT phase\n";
-        queryStr += R"asdasd(
-            FROM processed_measurement
-            INNER JOIN measurement ON id_measurement = measurement.id
-            INNER JOIN packet ON measurement.id_packet = packet.id
-            WHERE packet.experiment_id = @exp_id AND
-                  measurement.rx = @rx AND
-                  measurement.tx = @tx AND
-                  measurement.num_sub = @num_sub
-            ORDER BY packet.timestamp
-        )asdasd";
-        SQLite::Statement query(db, queryStr);
-        query.bind("@exp_id", getDBIndex());
-        query.bind("@rx", rx);
-        query.bind("@tx", tx);
-        query.bind("@num_sub", num_sub);
-        while(query.executeStep()) {
-            double val = query.getColumn(0);
-            result.push_back(val);
-        }
-        return result;
+    //ends the segment of the current marker (it's already written by addPoint), a new one is started by the next packet
+    void closeMarkerSegment() {
+        markerSegment = MarkerSegments::Segment();
     }
 
-    uint32_t getPacketsCount() {
-        SQLite::Database& db = DB_Handler::get_db();
+    //true if packets and measurements live in a shard database of their own
+    bool isSharded() const {
+        return !shardPath.empty();
+    }
 
-        SQLite::Statement query(db, "SELECT COUNT(1) FROM packet WHERE experiment_id = @exp_id");
-        query.bind("@exp_id", getDBIndex());
-        if(!query.executeStep())
-            return 0;
-        else
-            return query.getColumn(0).getUInt();
+    //schema with packets and measurements of the experiment, attaches the shard if needed
+    std::string schema(SQLite::Database& db) const {
+        return data().schema(db);
     }
 
-    uint32_t getPhotosCount() {
-        SQLite::Database& db = DB_Handler::get_db();
+    //ids and paths the read queries need, safe to copy to another thread
+    ExperimentData data() const {
+        return {dbIdx, shardPath, storesRawCsi()};
+    }
 
-        SQLite::Statement query(db, "SELECT COUNT(1) FROM image WHERE experiment_id = @exp_id");
-        query.bind("@exp_id", getDBIndex());
-        if(!query.executeStep())
-            return 0;
-        else
-            return query.getColumn(0).getUInt();
+    //without a preprocessor packets keep the integer CSI of the receiver,
+    //preprocessors store fractional or large values
+    bool storesRawCsi() const {
+        return !preprocHandler;
+    }
+
+    //first and last packet timestamps, unix seconds
+    std::optional<std::pair<int64_t, int64_t>> getTimeRange() const {
+        return data().getTimeRange(DB_Handler::get_db());
+    }
+
+    using Bucket = ExperimentData::Bucket;
+
+    std::vector<Bucket> getPointsBucketed(uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl,
+                                          int64_t from, int64_t to, size_t buckets)
+    {
+        if(buckets == 0 || to < from)
+            return {};
+        flushRollups();
+        return data().getPointsBucketed(DB_Handler::get_db(), rx, tx, num_sub, ampl, from, to, buckets);
+    }
+
+    std::vector<double> getPoints(uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl) const {
+        return data().getPoints(DB_Handler::get_db(), rx, tx, num_sub, ampl);
+    }
+
+    using RawPoint = ExperimentData::RawPoint;
+
+    std::vector<RawPoint> getRawPoints(uint32_t rx, uint32_t tx, uint32_t num_sub) const {
+        return data().getRawPoints(DB_Handler::get_db(), rx, tx, num_sub);
+    }
+
+    using TimedPoint = ExperimentData::TimedPoint;
+
+    std::vector<TimedPoint> getPointsInWindow(uint32_t rx, uint32_t tx, uint32_t num_sub, bool ampl,
+                                              int64_t fromNs, int64_t toNs)
+    {
+        return data().getPointsInWindow(DB_Handler::get_db(), rx, tx, num_sub, ampl, fromNs, toNs);
+    }
+
+    ExperimentStats::Stats getStats() const {
+        return data().getStats(DB_Handler::get_db());
+    }
+
+    uint32_t getPacketsCount() const {
+        return getStats().packets;
+    }
+
+    uint32_t getPhotosCount() const {
+        return getStats().photos;
     }
 
     int32_t getDBIndex() const {
@@ -205,6 +482,10 @@ public:
         query.bind("@path", filename);
         query.bind("@time", time);
         query.exec();
+
+        std::error_code ec;
+        uint64_t fileBytes = std::filesystem::file_size(std::filesystem::path("images") / filename, ec);
+        ExperimentStats::addPhoto(db, getDBIndex(), ec ? 0 : fileBytes);
     }
 
     struct ExportFilters {
@@ -217,8 +498,7 @@ public:
     };
 
     void exportData(std::string pathStr, ExportFilters filters, std::function<void(double)> progress_callback) {
-        if(!filters.marker)
-            filters.marker = "%";
+        PROFILE_ZONE("exportData");
 
         if(pathStr.back() != '/' && pathStr.back() != '\\')
             pathStr.push_back('/');
@@ -228,15 +508,30 @@ public:
         std::filesystem::create_directories(path / "photos");
 
         SQLite::Database& db = DB_Handler::get_db();
-
-        SQLite::Statement tx_rx_query(db, R"asd(
-            SELECT MAX(tx), MAX(rx), COUNT(measurement.id) FROM measurement
-            INNER JOIN packet ON id_packet = packet.id
-            INNER JOIN experiment ON experiment.id = packet.experiment_id
-            WHERE experiment.id = @exp_id AND packet.marker LIKE @marker
-        )asd");
+        const std::string dataSchema = schema(db);
+
+        //with a marker filter packets are read by the id ranges of matching segments
+        const std::string packetSource = filters.marker ?
+            R"asd(
+            data.marker_segment AS segment
+            INNER JOIN data.packet ON packet.id BETWEEN segment.first_packet AND segment.last_packet
+            )asd" :
+            "data.packet";
+        const std::string packetFilter = filters.marker ?
+            R"asd(
+            segment.experiment_id = @exp_id AND
+            segment.marker_id IN (SELECT id FROM data.marker WHERE text LIKE @marker) AND
+            packet.experiment_id = @exp_id
+            )asd" :
+            "packet.experiment_id = @exp_id";
+
+        SQLite::Statement tx_rx_query(db, qualifySql(
+            "SELECT MAX(tx), MAX(rx), COUNT(measurement.id) FROM " + packetSource + R"asd(
+            INNER JOIN data.measurement ON id_packet = packet.id
+            WHERE )asd" + packetFilter, dataSchema));
         tx_rx_query.bind("@exp_id", getDBIndex());
-        tx_rx_query.bind("@marker", *filters.marker);
+        if(filters.marker)
+            tx_rx_query.bind("@marker", *filters.marker);
         if(!tx_rx_query.executeStep())
             return;
         uint32_t tx_c = tx_rx_query.getColumn(0);
@@ -265,22 +560,23 @@ public:
         std::vector<std::vector<std::ofstream>> imagStreams = filters.real ? getStreams("imag") : std::vector<std::vector<std::ofstream>>{};
         std::vector<std::vector<std::ofstream>> realStreams = filters.imag ? getStreams("real") : std::vector<std::vector<std::ofstream>>{};
 
-        SQLite::Statement dataQuery(db, R"asd(
+        SQLite::Statement dataQuery(db, qualifySql(R"asd(
             SELECT measurement.num_sub, measurement.rx, measurement.tx, amplitude, phase, measurement.real_part, measurement.imag_part, packet.id
-            FROM processed_measurement
-            INNER JOIN measurement ON processed_measurement.id_measurement = measurement.id
-            INNER JOIN packet ON measurement.id_packet = packet.id
-            INNER JOIN experiment ON packet.experiment_id = experiment.id
-            WHERE experiment.id = @exp_id AND packet.marker LIKE @marker
+            FROM )asd" + packetSource + R"asd(
+            INNER JOIN data.measurement ON measurement.id_packet = packet.id
+            INNER JOIN data.processed_measurement ON processed_measurement.id_measurement = measurement.id
+            WHERE )asd" + packetFilter + R"asd(
             ORDER BY packet.id, measurement.num_sub
-        )asd");
+        )asd", dataSchema));
         dataQuery.bind("@exp_id", getDBIndex());
-        dataQuery.bind("@marker", *filters.marker);
+        if(filters.marker)
+            dataQuery.bind("@marker", *filters.marker);
 
         const size_t guiStep = 10;
         int64_t last_packet = -1;
         size_t passed_packs = 0;
         bool firstTime = true;
+        PROFILE_ZONE("exportData measurements");
         while(dataQuery.executeStep()) {
             uint32_t sub_car = dataQuery.getColumn(0);
             uint32_t rx = dataQuery.getColumn(1);
@@ -385,6 +681,21 @@ private:
         preprocHandler = conf.preprocHandler;
     }
 
+    //host time of the first packet and TSF of the first packet of every source, stored on first use
+    const PacketTime::Base& timeBase(SQLite::Database& db, const std::string& dataSchema, int64_t hostNs, uint16_t sourceId, uint64_t tsf) {
+        if(!packetTimeBase)
+            packetTimeBase = PacketTime::load(db, getDBIndex(), dataSchema);
+        if(!packetTimeBase) {
+            packetTimeBase = PacketTime::Base{hostNs, {}};
+            PacketTime::storeHost(db, getDBIndex(), dataSchema, hostNs);
+        }
+        if(tsf && !packetTimeBase->tsf.contains(sourceId)) {
+            packetTimeBase->tsf[sourceId] = static_cast<int64_t>(tsf);
+            PacketTime::storeTsf(db, getDBIndex(), dataSchema, sourceId, static_cast<int64_t>(tsf));
+        }
+        return *packetTimeBase;
+    }
+
     sigc::signal<void(Experiment&)> _updateSignal;
     sigc::signal<void(Experiment&)> _updateNameSignal;
 
@@ -395,10 +706,22 @@ private:
     std::optional<std::reference_wrapper<ReceiverHandler>> recvHandler;
     std::optional<std::reference_wrapper<PreprocessingHandler>> preprocHandler;
     nlohmann::json userConfig;
+    RollupAccumulator rollups;
+    MarkerSegments::Segment markerSegment;
+    std::optional<PacketTime::Base> packetTimeBase;
+    std::string shardPath;      //empty if the data is kept in the main database
 
     int32_t dbIdx = -1;
 };
 
+//Experiments matching the current filter, ordered by id.
+//
+//Only ids and names are kept for the list and they are read in pages with
+//keyset queries (id > last loaded id), the first page when the list is
+//reloaded and the next ones when rows past the loaded ones are asked for.
+//An Experiment with its parsed config and handlers is built only when it's
+//accessed and is kept until it's deleted, so reloading the list with another
+//filter doesn't parse anything again.
 class ExperimentsList {
 public:
 
@@ -409,49 +732,128 @@ public:
         std::optional<int32_t> transIdx  = std::nullopt;
     };
 
+    static constexpr size_t pageSize = 256;
+
     static ExperimentsList& getInstance() {
         static ExperimentsList inst;
         return inst;
     }
 
-    std::vector<Glib::ustring> getExperimentsNames() const {
-        std::vector<Glib::ustring> result;
-        result.reserve(experiments.size());
-        for(const auto& i : experiments) {
-            result.push_back(i.getName());
-        }
-        return result;
+    //rows matching the filter, including ones that aren't loaded yet
+    size_t getExperimentsCount() const {
+        return total;
+    }
+
+    //name of the row or nullptr if it isn't loaded yet, its page is requested then (see rowsChangedSignal)
+    const std::string* getExperimentName(size_t idx) {
+        if(idx < entries.size())
+            return &entries[idx].name;
+        requestRows(idx);
+        return nullptr;
     }
 
+    //loads the row and the experiment at once if needed, blocks on the database;
+    //the UI uses requestExperimentByIdx for rows it may not have built yet
     Experiment& getExperimentByIdx(size_t idx) {
-        return experiments.at(idx);
+        if(idx >= total)
+            throw std::out_of_range("No experiment at position " + std::to_string(idx));
+        if(idx >= entries.size())
+            loadRows(idx);
+        if(idx >= entries.size())
+            throw std::out_of_range("No experiment at position " + std::to_string(idx));
+        return getExperimentById(entries[idx].id);
     }
 
-    std::vector<Experiment>& getExperiments() {
-        return experiments;
+    //throws std::out_of_range if there is no such experiment
+    Experiment& getExperimentById(int32_t id) {
+        auto it = experiments.find(id);
+        if(it != experiments.end())
+            return *it->second;
+
+        auto details = loadDetails(DB_Handler::get_db(), id);
+        if(!details)
+            throw std::out_of_range("No experiment with id " + std::to_string(id));
+        return keep(makeExperiment(std::move(*details)));
     }
 
-    void deleteExperiment(const Experiment& exp) {
-        SQLite::Database& db = DB_Handler::get_db();
-        SQLite::Statement imagesQuery(db, "SELECT image_path FROM image WHERE experiment_id=@id");
-        imagesQuery.bind("@id", exp.dbIdx);
-        while(imagesQuery.executeStep()) {
-            if(!std::remove(imagesQuery.getColumn(0).getText()))
-                std::cerr << "Failed to delete file " << imagesQuery.getColumn(0).getText() << std::endl;
+    //Calls done with the experiment of the row, at once if it's built already,
+    //otherwise the row and the experiment are read through QueryExecutor and
+    //done is called when they come. A newer request replaces the waiting one,
+    //cancelExperimentRequest() drops it, done isn't called then
+    void requestExperimentByIdx(size_t idx, std::function<void(Experiment&)> done) {
+        if(idx >= total)
+            return;
+        std::optional<int32_t> knownId;
+        if(idx < entries.size()) {
+            knownId = entries[idx].id;
+            auto it = experiments.find(*knownId);
+            if(it != experiments.end()) {
+                cancelExperimentRequest();
+                done(*it->second);
+                return;
+            }
         }
 
-        SQLite::Statement query(db, "DELETE FROM experiment WHERE id=@id");
-        query.bind("@id", exp.dbIdx);
-        query.exec();
-        updateList(lastUsedFilter);
+        struct Loaded {
+            std::vector<Entry> page;
+            std::optional<Row> row;
+        };
+        const size_t limit = knownId ? 0 : rowsUpTo(idx);
+        const size_t inPage = knownId ? 0 : idx - entries.size();
+        QueryExecutor::getInstance().submit<Loaded>("experiment",
+            [filter = lastUsedFilter, after = lastLoadedId(), limit, inPage, knownId](SQLite::Database& db) {
+                Loaded loaded;
+                std::optional<int32_t> id = knownId;
+                if(limit) {
+                    loaded.page = loadPage(db, filter, after, limit);
+                    if(inPage < loaded.page.size())
+                        id = loaded.page[inPage].id;
+                }
+                if(id)
+                    loaded.row = loadDetails(db, *id);
+                return loaded;
+            },
+            [this, limit, done = std::move(done), forGeneration = generation](Loaded loaded) {
+                if(forGeneration != generation)
+                    return;
+                if(limit)
+                    mergePage(std::move(loaded.page), limit);
+                if(!loaded.row)
+                    return;
+                auto it = experiments.find(loaded.row->id);
+                done(it != experiments.end() ? *it->second : keep(makeExperiment(std::move(*loaded.row))));
+            });
+    }
+
+    void cancelExperimentRequest() {
+        QueryExecutor::getInstance().cancel("experiment");
+    }
+
+    //the experiment is hidden at once and removed by ExperimentDeleter in the background
+    void deleteExperiment(Experiment& exp) {
+        const int32_t id = exp.dbIdx;
+        exp.rollups = RollupAccumulator();
+        exp.markerSegment = MarkerSegments::Segment();
+        exp.packetTimeBase.reset();
+        if(exp.isSharded())
+            DB_Handler::detach_shard(DB_Handler::get_db(), id);
+        ExperimentDeleter::getInstance().enqueue(id);
+
+        auto it = std::find_if(entries.begin(), entries.end(), [id](const Entry& e) { return e.id == id; });
+        if(it != entries.end()) {
+            entries.erase(it);
+            total--;
+        }
+        experiments.erase(id);
+        _updateSignal.emit();
     }
 
     void deleteExperiment(size_t idx) {
-        deleteExperiment(experiments.at(idx));
+        deleteExperiment(getExperimentByIdx(idx));
     }
 
-    void addExperiment(FullExperimentConfig expConf) {
-        Experiment exp(expConf);
+    Experiment& addExperiment(FullExperimentConfig expConf) {
+        std::unique_ptr<Experiment> exp(new Experiment(expConf));
 
         SQLite::Database& db = DB_Handler::get_db();
         SQLite::Statement query(db, R"asd(
@@ -482,93 +884,285 @@ public:
 
         query.bind("@config", expConf.config.dump());
         query.exec();
-        exp.dbIdx = db.getLastInsertRowid();
-        experiments.emplace_back(std::move(exp));
+        exp->dbIdx = db.getLastInsertRowid();
+        exp->userConfig = expConf.config;
+
+        //"storage": "shard" keeps packets and measurements in a database of their own
+        if(expConf.config.is_object() && expConf.config.value("storage", "") == "shard") {
+            try {
+                exp->shardPath = DB_Handler::create_shard(exp->dbIdx);
+                SQLite::Statement setShard(db, "UPDATE experiment SET shard_path = @path WHERE id = @id");
+                setShard.bind("@path", exp->shardPath);
+                setShard.bind("@id", exp->dbIdx);
+                setShard.exec();
+            }
+            catch(const std::exception& ex) {
+                std::cerr << "Failed to create shard of experiment " << exp->dbIdx << ", using the main database: " << ex.what() << std::endl;
+                exp->shardPath.clear();
+            }
+        }
+
+        //it has the largest id, so it's the last row; if the list isn't loaded up to the end it's read with the last page
+        if(entries.size() == total)
+            entries.push_back({exp->dbIdx, exp->name});
+        total++;
+        Experiment& added = keep(std::move(exp));
 
         _updateSignal.emit();
+        return added;
     }
 
+    //writes rollups still kept in memory by all loaded experiments
+    void flushRollups() {
+        for(auto& [id, exp] : experiments) {
+            try {
+                exp->flushRollups();
+            }
+            catch(const std::exception& ex) {
+                std::cerr << "Failed to flush rollups of experiment " << exp->getName() << ": " << ex.what() << std::endl;
+            }
+        }
+    }
+
+    //reloads the list at once, blocks on the database
     void updateList(Filter filter) {
-        experiments.clear();
-        std::string requestStr = "SELECT id, name, description, hardware_tx_id, hardware_rx_id, config, recv_handler, preproc_handler FROM experiment";
-        std::vector<std::string> whatToDo;
+        applyListing(loadListing(DB_Handler::get_db(), filter), filter);
+    }
 
+    //reloads the list through QueryExecutor, updateSignal is emitted when it's done
+    void updateListAsync(Filter filter) {
+        QueryExecutor::getInstance().cancel("experiments_list_page");
+        QueryExecutor::getInstance().submit<Listing>("experiments_list",
+            [filter](SQLite::Database& db) { return loadListing(db, filter); },
+            [this, filter](Listing listing) { applyListing(std::move(listing), filter); });
+    }
+
+    //the whole list was replaced
+    sigc::signal<void()> updateSignal() const {
+        return _updateSignal;
+    }
+
+    //rows [position, position + removed) were replaced with added rows, emitted when pages are loaded or a row is renamed
+    sigc::signal<void(size_t, size_t, size_t)> rowsChangedSignal() const {
+        return _rowsChangedSignal;
+    }
+
+private:
+    struct Entry {
+        int32_t id = -1;
+        std::string name;
+    };
+
+    struct Listing {
+        size_t total = 0;
+        std::vector<Entry> firstPage;
+    };
+
+    //experiment row as read from the database, turned into an Experiment in the UI thread
+    struct Row {
+        int32_t id = -1;
+        std::string name;
+        std::string desc;
+        std::optional<int32_t> receiverId;
+        std::optional<int32_t> transmitterId;
+        std::string config;
+        std::string recvHandler;
+        std::string preprocHandler;
+        std::string shardPath;
+    };
+
+    static std::string filterCondition(const Filter& filter) {
+        std::string condition = "deleting = 0";
         if(filter.fromDate)
-            whatToDo.push_back("\n id IN (SELECT experiment.id FROM experiment JOIN packet ON packet.experiment_id = experiment.id WHERE timestamp > @min_time)");
+            condition += "\n AND id IN (SELECT experiment_id FROM experiment_stats WHERE last_timestamp > @min_time)";
         if(filter.upToDate)
-            whatToDo.push_back("\n id IN (SELECT experiment.id FROM experiment JOIN packet ON packet.experiment_id = experiment.id WHERE timestamp < @max_time)");
+            condition += "\n AND id IN (SELECT experiment_id FROM experiment_stats WHERE first_timestamp < @max_time)";
         if(filter.transIdx)
-            whatToDo.push_back("\n hardware_tx_id = @transIdx");
+            condition += "\n AND hardware_tx_id = @transIdx";
         if(filter.recvIdx)
-            whatToDo.push_back("\n hardware_rx_id = @recvIdx");
-
-        if(whatToDo.size() > 0) {
-            requestStr += "\nWHERE";
-            for(size_t i = 0; i < whatToDo.size() - 1; i++) {
-                requestStr += whatToDo[i];
-                requestStr += " AND ";
-            }
-            requestStr += whatToDo.back();
-        }
-
-        SQLite::Database& db = DB_Handler::get_db();
-        SQLite::Statement query(db, requestStr);
+            condition += "\n AND hardware_rx_id = @recvIdx";
+        return condition;
+    }
 
+    static void bindFilter(SQLite::Statement& query, const Filter& filter) {
         if(filter.fromDate) query.bind("@min_time", static_cast<uint32_t>(*filter.fromDate));
         if(filter.upToDate) query.bind("@max_time", static_cast<uint32_t>(*filter.upToDate));
         if(filter.transIdx) query.bind("@transIdx", static_cast<uint32_t>(*filter.transIdx));
         if(filter.recvIdx)  query.bind("@recvIdx",  static_cast<uint32_t>(*filter.recvIdx));
+    }
 
-        HW_List& hw_list = HW_List::get_instance();
+    //up to limit rows with ids greater than after
+    static std::vector<Entry> loadPage(SQLite::Database& db, const Filter& filter, int64_t after, size_t limit) {
+        SQLite::Statement query(db, "SELECT id, name FROM experiment\nWHERE " + filterCondition(filter) +
+                                    "\n AND id > @after\nORDER BY id\nLIMIT @limit");
+        bindFilter(query, filter);
+        query.bind("@after", after);
+        query.bind("@limit", static_cast<int64_t>(limit));
+
+        std::vector<Entry> page;
+        page.reserve(limit);
+        while(query.executeStep())
+            page.push_back({query.getColumn(0).getInt(), query.getColumn(1).getString()});
+        return page;
+    }
 
-        experiments.clear();
-        while(query.executeStep()) {
-            Experiment exp;
-            exp.dbIdx = query.getColumn(0);
-            exp.name = query.getColumn(1).getString();
-            exp.desc = query.getColumn(2).isNull() ? "" : query.getColumn(2).getString();
-            if(!query.getColumn(3).isNull())
-                exp.receiver = hw_list.get_hardware_by_db_idx(query.getColumn(3));
-            if(!query.getColumn(4).isNull())
-                exp.transmitter = hw_list.get_hardware_by_db_idx(query.getColumn(4));
-            std::string configStr = query.getColumn(5).isNull() ? "" : query.getColumn(5).getString();
-            try {
-                exp.userConfig = nlohmann::json::parse(configStr);
-            }
-            catch(const nlohmann::json::exception& ex) {}
-            std::string recv_hand_name = query.getColumn(6).isNull() ? "" : query.getColumn(6).getString();
-            try {
-                exp.recvHandler = HandlersList::getInstance().getRecvHandler(recv_hand_name);
-            }
-            catch(const std::out_of_range& ex) {}
-            std::string preprocc_hand_name = query.getColumn(7).isNull() ? "" : query.getColumn(7).getString();
-            try {
-                exp.preprocHandler = HandlersList::getInstance().getPreprocHandler(recv_hand_name);
-            }
-            catch(const std::out_of_range& ex) {}
-            experiments.emplace_back(std::move(exp));
+    static Listing loadListing(SQLite::Database& db, const Filter& filter) {
+        SQLite::Statement count(db, "SELECT COUNT(*) FROM experiment\nWHERE " + filterCondition(filter));
+        bindFilter(count, filter);
+        Listing listing;
+        if(count.executeStep())
+            listing.total = count.getColumn(0).getInt64();
+        listing.firstPage = loadPage(db, filter, std::numeric_limits<int64_t>::min(), pageSize);
+        return listing;
+    }
+
+    static std::optional<Row> loadDetails(SQLite::Database& db, int32_t id) {
+        SQLite::Statement query(db, R"asd(
+            SELECT name, description, hardware_tx_id, hardware_rx_id, config, recv_handler, preproc_handler, shard_path
+            FROM experiment
+            WHERE id = @id AND deleting = 0
+        )asd");
+        query.bind("@id", id);
+        if(!query.executeStep())
+            return std::nullopt;
+
+        Row row;
+        row.id = id;
+        row.name = query.getColumn(0).getString();
+        row.desc = query.getColumn(1).isNull() ? "" : query.getColumn(1).getString();
+        if(!query.getColumn(2).isNull())
+            row.receiverId = query.getColumn(2).getInt();
+        if(!query.getColumn(3).isNull())
+            row.transmitterId = query.getColumn(3).getInt();
+        row.config = query.getColumn(4).isNull() ? "" : query.getColumn(4).getString();
+        row.recvHandler = query.getColumn(5).isNull() ? "" : query.getColumn(5).getString();
+        row.preprocHandler = query.getColumn(6).isNull() ? "" : query.getColumn(6).getString();
+        row.shardPath = query.getColumn(7).isNull() ? "" : query.getColumn(7).getString();
+        return row;
+    }
+
+    static std::unique_ptr<Experiment> makeExperiment(Row row) {
+        HW_List& hw_list = HW_List::get_instance();
+        std::unique_ptr<Experiment> exp(new Experiment());
+        exp->dbIdx = row.id;
+        exp->name = std::move(row.name);
+        exp->desc = std::move(row.desc);
+        if(row.receiverId)
+            exp->receiver = hw_list.get_hardware_by_db_idx(*row.receiverId);
+        if(row.transmitterId)
+            exp->transmitter = hw_list.get_hardware_by_db_idx(*row.transmitterId);
+        try {
+            exp->userConfig = nlohmann::json::parse(row.config);
+        }
+        catch(const nlohmann::json::exception& ex) {}
+        try {
+            exp->recvHandler = HandlersList::getInstance().getRecvHandler(row.recvHandler);
         }
+        catch(const std::out_of_range& ex) {}
+        try {
+            exp->preprocHandler = HandlersList::getInstance().getPreprocHandler(row.preprocHandler);
+        }
+        catch(const std::out_of_range& ex) {}
+        exp->shardPath = std::move(row.shardPath);
+        return exp;
+    }
 
+    void applyListing(Listing listing, Filter filter) {
+        total = std::max(listing.total, listing.firstPage.size());
+        entries = std::move(listing.firstPage);
+        if(entries.size() < pageSize)
+            total = entries.size();
+        requestedUpTo = 0;
+        generation++;
         lastUsedFilter = filter;
         _updateSignal.emit();
     }
 
-    sigc::signal<void()> updateSignal() const {
-        return _updateSignal;
+    //rows to load so the row idx is loaded, rounded up to whole pages
+    size_t rowsUpTo(size_t idx) const {
+        return std::min(total, (idx / pageSize + 1) * pageSize) - entries.size();
+    }
+
+    int64_t lastLoadedId() const {
+        return entries.empty() ? std::numeric_limits<int64_t>::min() : entries.back().id;
+    }
+
+    //asks QueryExecutor for the pages up to the row idx
+    void requestRows(size_t idx) {
+        if(idx >= total || idx < requestedUpTo)
+            return;
+        const size_t limit = rowsUpTo(idx);
+        requestedUpTo = entries.size() + limit;
+        QueryExecutor::getInstance().submit<std::vector<Entry>>("experiments_list_page",
+            [filter = lastUsedFilter, after = lastLoadedId(), limit](SQLite::Database& db) { return loadPage(db, filter, after, limit); },
+            [this, limit, forGeneration = generation](std::vector<Entry> page) {
+                if(forGeneration != generation)
+                    return;
+                requestedUpTo = 0;
+                mergePage(std::move(page), limit);
+            });
+    }
+
+    //appends a page read after the rows loaded at the time of the request, rows loaded meanwhile are skipped
+    void mergePage(std::vector<Entry> page, size_t limit) {
+        const int64_t last = lastLoadedId();
+        auto fresh = std::find_if(page.begin(), page.end(), [last](const Entry& e) { return e.id > last; });
+        const size_t skipped = fresh - page.begin();
+        page.erase(page.begin(), fresh);
+        if(limit > skipped)
+            appendRows(std::move(page), limit - skipped);
+    }
+
+    //loads the pages up to the row idx at once
+    void loadRows(size_t idx) {
+        const size_t limit = rowsUpTo(idx);
+        appendRows(loadPage(DB_Handler::get_db(), lastUsedFilter, lastLoadedId(), limit), limit);
+    }
+
+    //a short page means the end of the list, it's shorter than counted if experiments were deleted meanwhile
+    void appendRows(std::vector<Entry> page, size_t limit) {
+        const size_t position = entries.size();
+        const size_t replaced = page.size() < limit ? total - position : page.size();
+        std::move(page.begin(), page.end(), std::back_inserter(entries));
+        if(page.size() < limit)
+            total = entries.size();
+        _rowsChangedSignal.emit(position, replaced, page.size());
     }
 
-private:
     Filter lastUsedFilter;
-    ExperimentsList() = default;
+    ExperimentsList() {
+        MarkerManager::getInstance().updateSignal().connect([this]() {
+            for(auto& [id, exp] : experiments)
+                exp->closeMarkerSegment();
+        });
+    }
 
     void addLocalExperiment(FullExperimentConfig config, size_t dbIdx) {
-        Experiment exp(config);
-        exp.dbIdx = dbIdx;
-        experiments.emplace_back(std::move(exp));
+        std::unique_ptr<Experiment> exp(new Experiment(config));
+        exp->dbIdx = dbIdx;
+        keep(std::move(exp));
+    }
+
+    //stores a built experiment, a new name of it is shown in its row
+    Experiment& keep(std::unique_ptr<Experiment> exp) {
+        Experiment& kept = *experiments.emplace(exp->dbIdx, std::move(exp)).first->second;
+        kept.updateNameSignal().connect([this](Experiment& renamed) {
+            auto it = std::find_if(entries.begin(), entries.end(), [&renamed](const Entry& e) { return e.id == renamed.getDBIndex(); });
+            if(it == entries.end())
+                return;
+            it->name = renamed.getName();
+            _rowsChangedSignal.emit(it - entries.begin(), 1, 1);
+        });
+        return kept;
     }
 
-    std::vector<Experiment> experiments;
+    size_t total = 0;               //rows matching lastUsedFilter
+    std::vector<Entry> entries;     //rows loaded so far, a prefix of the list
+    size_t requestedUpTo = 0;       //end of the rows requested from QueryExecutor, 0 if none are
+    uint64_t generation = 0;        //incremented on every reload, a page of an older one is dropped
+    std::map<int32_t, std::unique_ptr<Experiment>> experiments;    //built so far, by id
 
     sigc::signal<void()> _updateSignal;
+    sigc::signal<void(size_t, size_t, size_t)> _rowsChangedSignal;
 
 };
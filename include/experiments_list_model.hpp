@@ -0,0 +1,62 @@
+#pragma once
+
+#include "experiments_list.hpp"
+#include <giomm/listmodel.h>
+#include <glibmm/object.h>
+#include <gtk/gtk.h>
+
+//List model of ExperimentsList for the experiments list view.
+//
+//Items are GtkStringObjects with the names of the experiments, made only
+//for the rows the view asks for. A row that isn't loaded yet is shown as a
+//placeholder and its page is requested, the item is replaced when the page
+//comes.
+class ExperimentsListModel : public Glib::Object, public Gio::ListModel {
+public:
+
+    static Glib::RefPtr<ExperimentsListModel> create() {
+        return Glib::make_refptr_for_instance(new ExperimentsListModel());
+    }
+
+    //takes the count of ExperimentsList after it was reloaded
+    void reset() {
+        const guint removed = items;
+        items = ExperimentsList::getInstance().getExperimentsCount();
+        items_changed(0, removed, items);
+    }
+
+protected:
+    ExperimentsListModel() :
+        Glib::ObjectBase(typeid(ExperimentsListModel)),
+        Gio::ListModel()
+    {
+        items = ExperimentsList::getInstance().getExperimentsCount();
+        rowsChanged = ExperimentsList::getInstance().rowsChangedSignal().connect([this](size_t position, size_t removed, size_t added) {
+            items = items - removed + added;
+            items_changed(position, removed, added);
+        });
+    }
+
+    ~ExperimentsListModel() override {
+        rowsChanged.disconnect();
+    }
+
+    GType get_item_type_vfunc() override {
+        return GTK_TYPE_STRING_OBJECT;
+    }
+
+    guint get_n_items_vfunc() override {
+        return items;
+    }
+
+    gpointer get_item_vfunc(guint position) override {
+        if(position >= items)
+            return nullptr;
+        const std::string* name = ExperimentsList::getInstance().getExperimentName(position);
+        return gtk_string_object_new(name ? name->c_str() : "…");
+    }
+
+private:
+    guint items = 0;
+    sigc::connection rowsChanged;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+//Radix-2 complex FFT of many independent signals at once.
+//
+//Signals are stored interleaved: sample-major, signal-minor, i.e. sample n
+//of signal s is at [n * count + s], real and imaginary parts in separate
+//arrays. Every butterfly is then a plain loop over signals that vectorizes
+//well, and twiddles are computed once per transform size instead of once
+//per signal. Signals are processed in blocks so that the working set of a
+//block stays in cache across all log2(size) passes.
+class BatchFft {
+public:
+    static constexpr size_t blockBytes = 32 * 1024;
+
+    BatchFft() = default;
+
+    BatchFft(size_t size) {
+        setSize(size);
+    }
+
+    static bool isPowerOfTwo(size_t n) {
+        return n != 0 && (n & (n - 1)) == 0;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+    void setSize(size_t newSize) {
+        if(!isPowerOfTwo(newSize))
+            throw std::invalid_argument("BatchFft: size must be a power of two");
+        size = newSize;
+
+        size_t bits = 0;
+        while((size_t(1) << bits) < size)
+            bits++;
+        bitReversed.resize(size);
+        for(size_t i = 0; i < size; i++) {
+            size_t r = 0;
+            for(size_t b = 0; b < bits; b++) {
+                if(i & (size_t(1) << b))
+                    r |= size_t(1) << (bits - 1 - b);
+            }
+            bitReversed[i] = r;
+        }
+
+        twiddleRe.resize(size / 2);
+        twiddleIm.resize(size / 2);
+        for(size_t k = 0; k < size / 2; k++) {
+            twiddleRe[k] = std::cos(-2 * M_PI * k / size);
+            twiddleIm[k] = std::sin(-2 * M_PI * k / size);
+        }
+    }
+
+    //in-place forward transform of count signals
+    void forward(double* re, double* im, size_t count) const {
+        if(size < 2 || count == 0)
+            return;
+
+        const size_t block = std::max<size_t>(1, std::min(count, blockBytes / (2 * sizeof(double) * size)));
+        for(size_t first = 0; first < count; first += block) {
+            const size_t len = std::min(block, count - first);
+            permute(re + first, im + first, count, len);
+            for(size_t half = 1; half < size; half *= 2) {
+                pass(re + first, im + first, count, len, half);
+            }
+        }
+    }
+
+private:
+    size_t size = 0;
+    std::vector<size_t> bitReversed;
+    std::vector<double> twiddleRe;
+    std::vector<double> twiddleIm;
+
+    void permute(double* re, double* im, size_t stride, size_t len) const {
+        for(size_t i = 0; i < size; i++) {
+            size_t j = bitReversed[i];
+            if(j <= i)
+                continue;
+            double* __restrict ar = re + i * stride;
+            double* __restrict ai = im + i * stride;
+            double* __restrict br = re + j * stride;
+            double* __restrict bi = im + j * stride;
+#pragma omp simd
+            for(size_t s = 0; s < len; s++) {
+                std::swap(ar[s], br[s]);
+                std::swap(ai[s], bi[s]);
+            }
+        }
+    }
+
+    void pass(double* re, double* im, size_t stride, size_t len, size_t half) const {
+        const size_t step = size / (2 * half);
+        for(size_t start = 0; start < size; start += 2 * half) {
+            for(size_t k = 0; k < half; k++) {
+                const double wr = twiddleRe[k * step];
+                const double wi = twiddleIm[k * step];
+                double* __restrict ar = re + (start + k) * stride;
+                double* __restrict ai = im + (start + k) * stride;
+                double* __restrict br = re + (start + k + half) * stride;
+                double* __restrict bi = im + (start + k + half) * stride;
+#pragma omp simd
+                for(size_t s = 0; s < len; s++) {
+                    double tr = wr * br[s] - wi * bi[s];
+                    double ti = wr * bi[s] + wi * br[s];
+                    br[s] = ar[s] - tr;
+                    bi[s] = ai[s] - ti;
+                    ar[s] += tr;
+                    ai[s] += ti;
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Live frame bus: the capture pipeline publishes every decoded (and
+//preprocessed) frame into a POSIX shared memory ring, so local processes
+//can follow the stream without SQLite. There is one writer and any number
+//of readers; readers never block the writer and the writer never waits for
+//readers, a reader that falls behind by more than the ring loses frames.
+//This header has no dependencies besides libc and serves as the client
+//library too, see FrameBus::Reader.
+//
+//Binary layout, native byte order (little-endian on supported hosts):
+//  offset 0, 64 bytes, BusHeader
+//    u32 magic = 0x46434244 ("DBCF"), u32 version = 1
+//    u32 slot_count (power of two), u32 slot_size (bytes, multiple of 64)
+//    u64 published: frames published so far, frame n is in slot n % slot_count
+//    u64 skipped: frames that didn't fit into a slot
+//    32 reserved bytes
+//  offset 64 + i * slot_size: slot i
+//    u64 seq: 2n + 1 while frame n is being written, 2n + 2 when it's complete
+//    i64 host_ns: host receive time, ns since epoch
+//    u64 tsf: NIC timestamp, microseconds, 0 if unknown
+//    u16 source_id, u8 nr, u8 nc, u16 ns, u8 rssi, u8 noise, u8 chain_rssi[3], 5 reserved bytes
+//    f32 re[nr * nc * ns], f32 im[nr * nc * ns], stream index (rx * nc + tx) * ns + subcarrier
+//
+//Reading frame n (seqlock): load seq with acquire, it must be 2n + 2;
+//copy or use the slot; acquire fence; load seq again. The data is valid
+//only if seq didn't change, otherwise the frame was overwritten meanwhile.
+namespace FrameBus {
+
+constexpr uint32_t magic = 0x46434244;
+constexpr uint32_t version = 1;
+
+struct BusHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint64_t published;
+    uint64_t skipped;
+    uint8_t reserved[32];
+};
+static_assert(sizeof(BusHeader) == 64);
+
+struct FrameMeta {
+    int64_t hostNs = 0;
+    uint64_t tsf = 0;
+    uint16_t sourceId = 0;
+    uint8_t nr = 0;
+    uint8_t nc = 0;
+    uint16_t ns = 0;
+    uint8_t rssi = 0;
+    uint8_t noise = 0;
+    uint8_t chainRssi[3] {};
+    uint8_t reserved[5] {};
+
+    size_t values() const {
+        return static_cast<size_t>(nr) * nc * ns;
+    }
+};
+static_assert(sizeof(FrameMeta) == 32);
+
+struct SlotHeader {
+    uint64_t seq;
+    FrameMeta meta;
+};
+static_assert(sizeof(SlotHeader) == 40);
+
+inline std::atomic_ref<uint64_t> atomicAt(const uint64_t& value) {
+    return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(value));
+}
+
+//slot size holding nr x nc x ns frames
+inline uint32_t slotSizeFor(size_t values) {
+    size_t bytes = sizeof(SlotHeader) + 2 * values * sizeof(float);
+    return (bytes + 63) / 64 * 64;
+}
+
+//Mapping of a bus, shared by Writer and Reader
+class Mapping {
+public:
+    Mapping() = default;
+
+    ~Mapping() {
+        if(base != nullptr)
+            munmap(base, bytes);
+    }
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    const BusHeader& header() const {
+        return *static_cast<const BusHeader*>(base);
+    }
+
+    uint64_t published() const {
+        return atomicAt(header().published).load(std::memory_order_acquire);
+    }
+
+    uint64_t skipped() const {
+        return atomicAt(header().skipped).load(std::memory_order_relaxed);
+    }
+
+protected:
+    void* base = nullptr;
+    size_t bytes = 0;
+
+    BusHeader& mutableHeader() {
+        return *static_cast<BusHeader*>(base);
+    }
+
+    char* slot(uint64_t frame) const {
+        const BusHeader& h = header();
+        return static_cast<char*>(base) + sizeof(BusHeader) + (frame & (h.slotCount - 1)) * h.slotSize;
+    }
+};
+
+class Writer : public Mapping {
+public:
+
+    struct Settings {
+        std::string name = "/dbc_frames";   //shm_open name
+        uint32_t slots = 1024;              //rounded up to a power of two
+        size_t maxValues = 3 * 3 * 114;     //nr * nc * ns of the largest frame
+    };
+
+    //reads DBC_FRAME_BUS (shm name, e.g. /dbc_frames), DBC_FRAME_BUS_SLOTS and DBC_FRAME_BUS_VALUES
+    static std::optional<Settings> settingsFromEnv() {
+        const char* name = std::getenv("DBC_FRAME_BUS");
+        if(name == nullptr || *name == '\0')
+            return std::nullopt;
+
+        Settings settings;
+        settings.name = name;
+        try {
+            if(const char* slots = std::getenv("DBC_FRAME_BUS_SLOTS"))
+                settings.slots = std::stoul(slots);
+            if(const char* values = std::getenv("DBC_FRAME_BUS_VALUES"))
+                settings.maxValues = std::stoul(values);
+        }
+        catch(...) {
+            std::cerr << "FrameBus: incorrect DBC_FRAME_BUS_SLOTS or DBC_FRAME_BUS_VALUES" << std::endl;
+        }
+        return settings;
+    }
+
+    //nullptr if the bus can't be created
+    static std::unique_ptr<Writer> create(const Settings& settings) {
+        auto writer = std::unique_ptr<Writer>(new Writer());
+        if(!writer->open(settings))
+            return nullptr;
+        return writer;
+    }
+
+    ~Writer() {
+        if(!name.empty())
+            shm_unlink(name.c_str());
+    }
+
+    //fill(float* re, float* im) writes meta.values() values of every part straight into the slot
+    template<typename Fill>
+    bool publish(const FrameMeta& meta, Fill&& fill) {
+        const BusHeader& h = header();
+        if(sizeof(SlotHeader) + 2 * meta.values() * sizeof(float) > h.slotSize) {
+            atomicAt(h.skipped).fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        SlotHeader* dst = reinterpret_cast<SlotHeader*>(slot(next));
+        auto seq = atomicAt(dst->seq);
+        seq.store(2 * next + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(&dst->meta, &meta, sizeof(meta));
+        float* re = reinterpret_cast<float*>(dst + 1);
+        fill(re, re + meta.values());
+
+        seq.store(2 * next + 2, std::memory_order_release);
+        next++;
+        atomicAt(h.published).store(next, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::string name;
+    uint64_t next = 0;
+
+    Writer() = default;
+
+    bool open(const Settings& settings) {
+        uint32_t slots = 1;
+        while(slots < settings.slots) {
+            slots <<= 1;
+        }
+        const uint32_t slotSize = slotSizeFor(settings.maxValues);
+        bytes = sizeof(BusHeader) + static_cast<size_t>(slots) * slotSize;
+
+        //readers of a previous bus keep their mapping of the unlinked object
+        shm_unlink(settings.name.c_str());
+        int fd = shm_open(settings.name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0 || ftruncate(fd, bytes) != 0) {
+            std::cerr << "FrameBus: unable to create " << settings.name << ": " << std::strerror(errno) << std::endl;
+            if(fd >= 0)
+                close(fd);
+            return false;
+        }
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(base == MAP_FAILED) {
+            std::cerr << "FrameBus: unable to map " << settings.name << ": " << std::strerror(errno) << std::endl;
+            base = nullptr;
+            shm_unlink(settings.name.c_str());
+            return false;
+        }
+        name = settings.name;
+
+        //the header is completed last, readers check magic before anything else
+        BusHeader& h = mutableHeader();
+        h.version = version;
+        h.slotCount = slots;
+        h.slotSize = slotSize;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::atomic_ref<uint32_t>(h.magic).store(magic, std::memory_order_release);
+        return true;
+    }
+};
+
+//Client side. Reader starts at the live end of the stream; next() walks
+//forward frame by frame and skips whatever was overwritten before it got
+//there. Nothing is ever written into the bus by readers.
+class Reader : public Mapping {
+public:
+
+    enum class Status {
+        Ok,
+        NotYet,         //frame isn't published yet
+        Overwritten     //the writer has reused the slot, the frame is lost
+    };
+
+    struct FrameView {
+        const FrameMeta* meta;
+        const float* re;
+        const float* im;
+    };
+
+    struct Frame {
+        FrameMeta meta;
+        std::vector<float> re;
+        std::vector<float> im;
+    };
+
+    //nullptr if there is no bus with this name or it isn't compatible
+    static std::unique_ptr<Reader> open(const std::string& name) {
+        auto reader = std::unique_ptr<Reader>(new Reader());
+        if(!reader->map(name))
+            return nullptr;
+        reader->cursor = reader->published();
+        return reader;
+    }
+
+    //Calls f(const FrameView&) with frame n in place. The view points into
+    //the shared memory and may change under f, whatever f computed is valid
+    //only if Ok is returned
+    template<typename F>
+    Status read(uint64_t n, F&& f) const {
+        if(n >= published())
+            return Status::NotYet;
+        const SlotHeader* src = reinterpret_cast<const SlotHeader*>(slot(n));
+        const uint64_t expected = 2 * n + 2;
+        const uint64_t before = atomicAt(src->seq).load(std::memory_order_acquire);
+        if(before != expected)
+            return before < expected ? Status::NotYet : Status::Overwritten;
+
+        FrameMeta meta;
+        std::memcpy(&meta, &src->meta, sizeof(meta));
+        if(sizeof(SlotHeader) + 2 * meta.values() * sizeof(float) > header().slotSize)
+            return Status::Overwritten;
+        const float* re = reinterpret_cast<const float*>(src + 1);
+        f(FrameView{&meta, re, re + meta.values()});
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(atomicAt(src->seq).load(std::memory_order_relaxed) != before)
+            return Status::Overwritten;
+        return Status::Ok;
+    }
+
+    //Reads the frame at the cursor in place, see read(). Moves the cursor
+    //on Ok and over lost frames
+    template<typename F>
+    Status next(F&& f) {
+        const uint64_t head = published();
+        const uint64_t oldest = head > header().slotCount ? head - header().slotCount : 0;
+        if(cursor < oldest) {
+            lostFrames += oldest - cursor;
+            cursor = oldest;
+        }
+        Status status = read(cursor, std::forward<F>(f));
+        if(status == Status::Ok) {
+            cursor++;
+        }
+        else if(status == Status::Overwritten) {
+            lostFrames++;
+            cursor++;
+        }
+        return status;
+    }
+
+    //next frame copied out of the bus, std::nullopt if there is none yet
+    std::optional<Frame> next() {
+        Frame frame;
+        Status status;
+        do {
+            status = next([&frame](const FrameView& view) {
+                frame.meta = *view.meta;
+                frame.re.assign(view.re, view.re + view.meta->values());
+                frame.im.assign(view.im, view.im + view.meta->values());
+            });
+        } while(status == Status::Overwritten);
+        if(status != Status::Ok)
+            return std::nullopt;
+        return frame;
+    }
+
+    uint64_t position() const {
+        return cursor;
+    }
+
+    //frames the reader missed because it was too slow
+    uint64_t lost() const {
+        return lostFrames;
+    }
+
+private:
+    uint64_t cursor = 0;
+    uint64_t lostFrames = 0;
+
+    Reader() = default;
+
+    bool map(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(BusHeader)) {
+            close(fd);
+            return false;
+        }
+        bytes = st.st_size;
+        base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(base == MAP_FAILED) {
+            base = nullptr;
+            return false;
+        }
+
+        const BusHeader& h = header();
+        if(std::atomic_ref<uint32_t>(const_cast<uint32_t&>(h.magic)).load(std::memory_order_acquire) != magic ||
+           h.version != version || h.slotCount == 0 || (h.slotCount & (h.slotCount - 1)) != 0 ||
+           sizeof(BusHeader) + static_cast<size_t>(h.slotCount) * h.slotSize > bytes)
+        {
+            std::cerr << "FrameBus: " << name << " isn't a compatible frame bus" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "handler_base.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//Merges frames of several sources into one stream ordered by
+//FrameInfo::hostNs. Every source is expected to deliver its own frames in
+//order, so only the heads of the sources are compared: they are kept in a
+//binary min-heap and a frame costs O(log k) for k sources.
+//
+//A frame is released when every source has a frame waiting (nothing older
+//can come anymore) or when it's older than the watermark passed to pop():
+//sources that are silent for longer than the allowed delay don't hold the
+//others back.
+class FrameMerger {
+public:
+
+    explicit FrameMerger(size_t sources = 0) {
+        resize(sources);
+    }
+
+    void resize(size_t sources) {
+        pending.assign(sources, {});
+        heap.clear();
+        nonEmpty = 0;
+    }
+
+    size_t sources() const {
+        return pending.size();
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for(const auto& p : pending) {
+            total += p.size();
+        }
+        return total;
+    }
+
+    void push(size_t source, CapturedFrame frame) {
+        std::deque<CapturedFrame>& queue = pending.at(source);
+        queue.push_back(std::move(frame));
+        if(queue.size() == 1) {
+            nonEmpty++;
+            pushHead(source);
+        }
+    }
+
+    //the oldest frame if it may be released, watermarkNs is the time before
+    //which no source is going to deliver frames anymore
+    std::optional<CapturedFrame> pop(int64_t watermarkNs) {
+        if(heap.empty())
+            return std::nullopt;
+        if(nonEmpty < pending.size() && heap.front().first > watermarkNs)
+            return std::nullopt;
+
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+        size_t source = heap.back().second;
+        heap.pop_back();
+
+        std::deque<CapturedFrame>& queue = pending[source];
+        CapturedFrame frame = std::move(queue.front());
+        queue.pop_front();
+        if(queue.empty())
+            nonEmpty--;
+        else
+            pushHead(source);
+        return frame;
+    }
+
+private:
+    std::vector<std::deque<CapturedFrame>> pending;
+    std::vector<std::pair<int64_t, size_t>> heap;   //(hostNs of the head, source)
+    size_t nonEmpty = 0;
+
+    void pushHead(size_t source) {
+        heap.emplace_back(pending[source].front().info.hostNs, source);
+        std::push_heap(heap.begin(), heap.end(), std::greater<>());
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <glibmm/ustring.h>
+#include <nlohmann/json.hpp>
+
+template <typename K, typename V>
+V getDefault(nlohmann::json js, K key, V defaultV) {
+    if(js[key].is_null())
+        return defaultV;
+    else
+        return js[key];
+}
+
+//Per-frame metadata that doesn't fit into HandlerBase::datatype
+struct FrameInfo {
+    uint8_t rssi = 0;                       //combined rx frame RSSI, dB
+    std::array<uint8_t, 3> chainRssi {};    //RSSI of every rx chain, dB
+    uint8_t noise = 0;
+    uint64_t hwTimestamp = 0;               //TSF of the NIC, microseconds, 0 if unknown
+    int64_t hostNs = 0;                     //host receive time, ns since epoch, 0 if unknown
+    uint16_t sourceId = 0;                  //receiver instance of MultiReceiver, 0 for single receivers
+};
+
+class HandlerBase {
+friend class HandlersList;
+public:
+    //real and imag (ampl and phase)
+    //recv
+    //trans
+    //subcarrier
+    typedef std::pair<std::vector<std::vector<std::vector<double>>>,
+                      std::vector<std::vector<std::vector<double>>>> datatype;
+
+    virtual Glib::ustring getName() const = 0;
+
+    virtual void set_settings(nlohmann::json config) = 0;
+
+};
+
+//frame together with its metadata, as it's passed between threads
+struct CapturedFrame {
+    HandlerBase::datatype data;
+    FrameInfo info;
+};
+
+class PreprocessingHandler : public HandlerBase {
+public:
+    Glib::ustring getName() const override {
+        return "Стандартный предобработчик";
+    }
+
+    //info describes the frame as the receiver got it, default constructed if unknown.
+    //std::nullopt means the frame has to be skipped
+    virtual std::optional<HandlerBase::datatype> process(const HandlerBase::datatype& toProcess, const FrameInfo& /*info*/ = FrameInfo()) {
+        return toProcess;
+    }
+
+    //forgets everything accumulated from previous frames
+    virtual void reset() {}
+
+    void set_settings(nlohmann::json) override {}
+
+};
@@ -6,40 +6,21 @@
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <atomic>
+#include <chrono>
 #include <array>
 #include <mutex>
 #include <thread>
 #include <list>
+#include <deque>
 #include <SFML/Network.hpp>
 #include <iostream>
-
-extern "C" {
-#include "csi_fun.h"
-}
-
-template <typename K, typename V>
-V getDefault(nlohmann::json js, K key, V defaultV) {
-    if(js[key].is_null())
-        return defaultV;
-    else
-        return js[key];
-}
-
-class HandlerBase {
-friend class HandlersList;
-public:
-    //real and imag (ampl and phase)
-    //recv
-    //trans
-    //subcarrier
-    typedef std::pair<std::vector<std::vector<std::vector<double>>>,
-                      std::vector<std::vector<std::vector<double>>>> datatype;
-
-    virtual Glib::ustring getName() const = 0;
-
-    virtual void set_settings(nlohmann::json config) = 0;
-
-};
+#include "metrics.hpp"
+#include "handler_base.hpp"
+#include "preprocessors.hpp"
+#include "spectrogram.hpp"
+#include "pca.hpp"
+#include "csi_parser.hpp"
+#include "frame_merger.hpp"
 
 class ReceiverHandler : public HandlerBase {
 public:
@@ -59,10 +40,19 @@ public:
         return paused;
     }
 
+    //metadata of the frame last returned by tryCollect
+    virtual FrameInfo getLastFrameInfo() const {
+        return lastInfo;
+    }
+
+    //takes back a frame returned by tryCollect once it isn't needed, so its buffers can be reused
+    virtual void recycle(HandlerBase::datatype&&) {}
+
     void set_settings(nlohmann::json config) override {}
 
 protected:
     bool paused = true;
+    FrameInfo lastInfo;
 
 };
 
@@ -113,42 +103,33 @@ public:
             sf::IpAddress                sender;
             unsigned short               senderPort;
 
-            HandlerBase::datatype bufferToTransfer;
-
             sf::Socket::Status status = socket.receive(in, sizeof(in), received, sender, senderPort);
             if(status != sf::Socket::Status::Done) {
                 return std::nullopt;
             }
-
-            csi_struct csi_status;
-            record_status(in, received, &csi_status);
-
-            if(csi_status.payload_len < 1056) {
+            const int64_t receivedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            Metrics& metrics = Metrics::getInstance();
+            metrics.add(Metrics::Counter::Packets);
+            metrics.add(Metrics::Counter::Bytes, received);
+
+            auto datagram = CsiParser::Datagram::parse({in, received});
+            if(!datagram || datagram->header().payloadLen < 1056) {
+                metrics.add(Metrics::Counter::Drops);
                 return std::nullopt;
             }
-
-            size_t nr = std::min(static_cast<uint8_t>(csi_status.nr), recv_antennas);
-            size_t nc = std::min(static_cast<uint8_t>(csi_status.nc), trans_antenntas);
-            size_t maxSubcars = std::min(static_cast<uint16_t>(csi_status.num_tones), subcarriers);
-
-            std::vector<unsigned char> data_buf(csi_status.payload_len);
-            COMPLEX csi_matrix[3][3][114];
-            record_csi_payload(in, &csi_status, &data_buf[0], csi_matrix);
-
-            bufferToTransfer.first.resize(nr);
-            bufferToTransfer.second.resize(nr);
-            for(size_t i = 0; i < nr; i++) {
-                bufferToTransfer.first[i].resize(nc);
-                bufferToTransfer.second[i].resize(nc);
-                for(size_t j = 0; j < nc; j++) {
-                    bufferToTransfer.first[i][j].resize(maxSubcars);
-                    bufferToTransfer.second[i][j].resize(maxSubcars);
-                    for(size_t sub_car = 0; sub_car < maxSubcars; sub_car++) {
-                        bufferToTransfer.first[i][j][sub_car] = csi_matrix[i][j][sub_car].real;
-                        bufferToTransfer.second[i][j][sub_car] = csi_matrix[i][j][sub_car].imag;
-                    }
-                }
-            }
+            const CsiParser::Header& header = datagram->header();
+
+            lastInfo.rssi = header.rssi;
+            lastInfo.chainRssi = {header.rssi0, header.rssi1, header.rssi2};
+            lastInfo.noise = header.noise;
+            lastInfo.hwTimestamp = header.tstamp;
+            lastInfo.hostNs = receivedNs;
+
+            //decoded into the buffers of a recycled frame, only their sizes are changed
+            HandlerBase::datatype bufferToTransfer = std::move(spare);
+            spare = HandlerBase::datatype();
+            datagram->decode(bufferToTransfer, recv_antennas, trans_antenntas, subcarriers);
             return std::move(bufferToTransfer);
         }
         catch(std::exception& ex) {
@@ -157,6 +138,7 @@ public:
         catch(...) {
             std::cerr << "RouterReceiver: unknown error" << std::endl;
         }
+        Metrics::getInstance().add(Metrics::Counter::Drops);
         return std::nullopt;
     }
 
@@ -164,8 +146,24 @@ public:
         return "UDP сервер для роутеров";
     }
 
+    void recycle(HandlerBase::datatype&& frame) override {
+        spare = std::move(frame);
+    }
+
+    //blocks until a datagram is waiting or timeoutMs passes
+    bool waitReadable(int timeoutMs) {
+        if(paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+            return false;
+        }
+        sf::SocketSelector selector;
+        selector.add(socket);
+        return selector.wait(sf::milliseconds(timeoutMs));
+    }
+
 private:
     sf::UdpSocket socket;
+    HandlerBase::datatype spare;    //frame given back by recycle
 
     size_t port = 50000;
     uint8_t recv_antennas = 3;
@@ -174,18 +172,161 @@ private:
 
 };
 
-class PreprocessingHandler : public HandlerBase {
+//Several RouterReceiver instances capturing into one experiment, e.g. a
+//router per room corner. Every source is received and decoded on a thread
+//of its own, frames get FrameInfo::sourceId (index in "sources" plus one)
+//and are handed over to tryCollect either as they come or, with
+//"merge": "timestamp", ordered by host receive time by FrameMerger.
+//
+//Settings are read from the experiment config:
+//  "sources":  [{"port": 50000}, {"port": 50001}]  (other keys as for RouterReceiver)
+//  "merge":    "arrival" | "timestamp"
+//  "merge_delay_ms": 20                             (how long a silent source may hold the others)
+class MultiReceiver : public ReceiverHandler {
 public:
+    MultiReceiver() = default;
+
+    ~MultiReceiver() {
+        stopSources();
+    }
+
+    void set_settings(nlohmann::json config) override {
+        stopSources();
+        sources.clear();
+        nlohmann::json sourcesConfig = config["sources"];
+        if(sourcesConfig.is_array()) {
+            for(size_t i = 0; i < sourcesConfig.size(); i++) {
+                nlohmann::json sourceConfig = config;
+                sourceConfig.erase("sources");
+                if(sourcesConfig[i].is_object())
+                    sourceConfig.update(sourcesConfig[i]);
+                auto source = std::make_unique<Source>();
+                source->receiver.set_settings(sourceConfig);
+                source->id = i + 1;
+                sources.push_back(std::move(source));
+            }
+        }
+        byTimestamp = getDefault(config, "merge", std::string("arrival")) == "timestamp";
+        mergeDelayNs = getDefault(config, "merge_delay_ms", mergeDelayNs / 1000000) * 1000000;
+        merger.resize(sources.size());
+        if(!paused)
+            startSources();
+    }
+
+    void set_pause(bool val=true) override {
+        if(val == paused)
+            return;
+        ReceiverHandler::set_pause(val);
+        if(val)
+            stopSources();
+        else
+            startSources();
+    }
+
+    std::optional<HandlerBase::datatype> tryCollect() override {
+        if(sources.empty())
+            return std::nullopt;
+
+        std::optional<CapturedFrame> frame = byTimestamp ? nextByTimestamp() : nextByArrival();
+        if(!frame)
+            return std::nullopt;
+        lastInfo = frame->info;
+        return std::move(frame->data);
+    }
+
     Glib::ustring getName() const override {
-        return "Стандартный предобработчик";
+        return "Несколько UDP серверов";
     }
 
-    virtual std::optional<HandlerBase::datatype> process(const HandlerBase::datatype& toProcess) {
-        return toProcess;
+private:
+    static constexpr size_t maxQueued = 4096;   //frames per source, the oldest ones are dropped above it
+    static constexpr int waitMs = 100;
+
+    struct Source {
+        RouterReceiver receiver;
+        uint16_t id = 0;
+        std::mutex mutex;
+        std::deque<CapturedFrame> queue;
+        std::jthread worker;
+    };
+
+    std::vector<std::unique_ptr<Source>> sources;
+    bool byTimestamp = false;
+    int64_t mergeDelayNs = 20000000;
+    FrameMerger merger;
+    size_t nextSource = 0;
+    std::deque<CapturedFrame> taken;
+
+    static void receive(std::stop_token stoken, Source& source) {
+        while(!stoken.stop_requested()) {
+            if(!source.receiver.waitReadable(waitMs))
+                continue;
+            while(auto data = source.receiver.tryCollect()) {
+                CapturedFrame frame{std::move(*data), source.receiver.getLastFrameInfo()};
+                frame.info.sourceId = source.id;
+                std::lock_guard lock(source.mutex);
+                if(source.queue.size() >= maxQueued) {
+                    source.queue.pop_front();
+                    Metrics::getInstance().add(Metrics::Counter::Drops);
+                }
+                source.queue.push_back(std::move(frame));
+            }
+        }
     }
 
-    void set_settings(nlohmann::json config) override {}
+    void startSources() {
+        for(auto& source : sources) {
+            source->receiver.set_pause(false);
+            source->worker = std::jthread(receive, std::ref(*source));
+        }
+    }
+
+    void stopSources() {
+        for(auto& source : sources) {
+            if(source->worker.joinable()) {
+                source->worker.request_stop();
+                source->worker.join();
+            }
+            source->receiver.set_pause(true);
+            std::lock_guard lock(source->mutex);
+            source->queue.clear();
+        }
+        merger.resize(sources.size());
+        taken.clear();
+    }
+
+    //sources are visited round robin, every visit takes all frames waiting in it
+    std::optional<CapturedFrame> nextByArrival() {
+        for(size_t i = 0; i < sources.size() && taken.empty(); i++) {
+            Source& source = *sources[nextSource];
+            nextSource = (nextSource + 1) % sources.size();
+            std::lock_guard lock(source.mutex);
+            taken.swap(source.queue);
+        }
+        if(taken.empty())
+            return std::nullopt;
+        CapturedFrame frame = std::move(taken.front());
+        taken.pop_front();
+        return frame;
+    }
 
+    std::optional<CapturedFrame> nextByTimestamp() {
+        for(size_t i = 0; i < sources.size(); i++) {
+            {
+                std::lock_guard lock(sources[i]->mutex);
+                taken.swap(sources[i]->queue);
+            }
+            for(auto& frame : taken) {
+                merger.push(i, std::move(frame));
+            }
+            taken.clear();
+        }
+        Metrics::getInstance().set(Metrics::Gauge::ReceiveQueue, merger.size());
+
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        return merger.pop(now - mergeDelayNs);
+    }
 };
 
 class HandlersList {
@@ -247,7 +388,15 @@ private:
     {
         receivers.emplace_back(new ReceiverHandler());
         receivers.emplace_back(new RouterReceiver());
+        receivers.emplace_back(new MultiReceiver());
         preprocessor.emplace_back(new PreprocessingHandler());
+        preprocessor.emplace_back(new HampelFilter());
+        preprocessor.emplace_back(new MovingAverageFilter());
+        preprocessor.emplace_back(new EwmaFilter());
+        preprocessor.emplace_back(new PhaseSanitizer());
+        preprocessor.emplace_back(new RssiNormalizer());
+        preprocessor.emplace_back(new DopplerSpectrogram());
+        preprocessor.emplace_back(new PcaReducer());
 
         for(size_t i = 0; i < receivers.size(); i++) {
             recvNameToIdx[receivers[i]->getName()] = i;
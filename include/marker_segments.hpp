@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <SQLiteCpp/SQLiteCpp.h>
+#include "sql_qualify.hpp"
+
+//Markers are stored once in the marker dictionary, packets keep marker_id.
+//Packets with the same marker come in runs (the marker is changed by hand),
+//so every run is kept in marker_segment as a range of packet ids and
+//marker filters read packets by id ranges instead of matching every row.
+//
+//The open segment of an experiment is kept in memory by Experiment and
+//written with every packet, in the same transaction; a segment is written
+//many times and is merged by the upsert on (experiment_id, first_packet).
+//Both tables live next to the packets, see qualifySql.
+namespace MarkerSegments {
+
+struct Segment {
+    int64_t markerId = -1;
+    int64_t firstPacket = -1;
+    int64_t lastPacket = -1;
+
+    bool isOpen() const {
+        return firstPacket >= 0;
+    }
+};
+
+inline int64_t markerId(SQLite::Database& db, const std::string& schema, const std::string& text) {
+    SQLite::Statement insert(db, qualifySql("INSERT OR IGNORE INTO data.marker (text) VALUES (@text)", schema));
+    insert.bind("@text", text);
+    insert.exec();
+    SQLite::Statement select(db, qualifySql("SELECT id FROM data.marker WHERE text = @text", schema));
+    select.bind("@text", text);
+    select.executeStep();
+    return select.getColumn(0).getInt64();
+}
+
+inline void write(SQLite::Database& db, int32_t expId, const std::string& schema, const Segment& segment) {
+    if(!segment.isOpen())
+        return;
+    SQLite::Statement upsert(db, qualifySql(R"asd(
+        INSERT INTO data.marker_segment (experiment_id, marker_id, first_packet, last_packet)
+        VALUES (@exp_id, @marker_id, @first, @last)
+        ON CONFLICT (experiment_id, first_packet) DO UPDATE SET
+            last_packet = MAX(last_packet, excluded.last_packet)
+    )asd", schema));
+    upsert.bind("@exp_id", expId);
+    upsert.bind("@marker_id", segment.markerId);
+    upsert.bind("@first", segment.firstPacket);
+    upsert.bind("@last", segment.lastPacket);
+    upsert.exec();
+}
+
+//Moves marker text left in packet rows (older databases, import) into the
+//dictionary and recomputes the segments of the experiment
+inline void rebuild(SQLite::Database& db, int32_t expId, const std::string& schema = "main") {
+    SQLite::Statement dictionary(db, qualifySql(R"asd(
+        INSERT OR IGNORE INTO data.marker (text)
+        SELECT DISTINCT marker FROM data.packet WHERE experiment_id = @exp_id AND marker IS NOT NULL
+    )asd", schema));
+    dictionary.bind("@exp_id", expId);
+    dictionary.exec();
+
+    SQLite::Statement encode(db, qualifySql(R"asd(
+        UPDATE data.packet SET
+            marker_id = (SELECT id FROM data.marker WHERE text = packet.marker),
+            marker = NULL
+        WHERE experiment_id = @exp_id AND marker IS NOT NULL
+    )asd", schema));
+    encode.bind("@exp_id", expId);
+    encode.exec();
+
+    SQLite::Statement clear(db, qualifySql("DELETE FROM data.marker_segment WHERE experiment_id = @exp_id", schema));
+    clear.bind("@exp_id", expId);
+    clear.exec();
+
+    //runs of equal marker_id: the difference of the two row numbers is constant within a run
+    SQLite::Statement fill(db, qualifySql(R"asd(
+        INSERT INTO data.marker_segment (experiment_id, marker_id, first_packet, last_packet)
+        SELECT @exp_id, marker_id, MIN(id), MAX(id)
+        FROM (SELECT id, marker_id,
+                     ROW_NUMBER() OVER (ORDER BY id) - ROW_NUMBER() OVER (PARTITION BY marker_id ORDER BY id) AS run
+              FROM data.packet WHERE experiment_id = @exp_id AND marker_id IS NOT NULL)
+        GROUP BY marker_id, run
+    )asd", schema));
+    fill.bind("@exp_id", expId);
+    fill.exec();
+}
+
+}
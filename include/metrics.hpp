@@ -0,0 +1,300 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+//Latency histogram with HDR-like layout: values below 16 get a bucket each,
+//every next power of two is split into 16 linear buckets, so the relative
+//error stays under 1/16 over the whole uint64 range.
+//record() is a couple of relaxed atomic increments and never locks.
+class LatencyHistogram {
+public:
+    static constexpr unsigned subBits = 4;
+    static constexpr uint64_t subCount = 1 << subBits;
+    static constexpr size_t bucketsCount = subCount + (64 - subBits) * subCount;
+
+    void record(uint64_t value) {
+        counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t curMax = maxValue.load(std::memory_order_relaxed);
+        while(value > curMax && !maxValue.compare_exchange_weak(curMax, value, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t getCount() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getSum() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMax() const {
+        return maxValue.load(std::memory_order_relaxed);
+    }
+
+    //upper bound of the bucket containing the p-th quantile, p in [0, 1]
+    uint64_t percentile(double p) const {
+        uint64_t count = getCount();
+        if(count == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for(size_t i = 0; i < bucketsCount; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if(seen >= rank)
+                return std::min(bucketUpperBound(i), getMax());
+        }
+        return getMax();
+    }
+
+    static size_t bucketIndex(uint64_t value) {
+        if(value < subCount)
+            return value;
+        unsigned msb = 63 - __builtin_clzll(value);
+        unsigned exp = msb - subBits;
+        uint64_t mantissa = value >> exp;       //in [subCount, 2 * subCount)
+        return subCount + exp * subCount + (mantissa - subCount);
+    }
+
+    static uint64_t bucketUpperBound(size_t idx) {
+        if(idx < subCount)
+            return idx;
+        uint64_t exp = (idx - subCount) / subCount;
+        uint64_t mantissa = subCount + (idx - subCount) % subCount;
+        return ((mantissa + 1) << exp) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucketsCount> counts {};
+    std::atomic<uint64_t> total = 0;
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint64_t> maxValue = 0;
+};
+
+//Process-wide instrumentation of the capture pipeline.
+//Every stage has a latency histogram in nanoseconds, counters and gauges
+//are plain atomics, so recording is safe from any thread.
+class Metrics {
+public:
+
+    enum class Stage {
+        Collect = 0,        //ReceiverHandler::tryCollect that returned a frame
+        Preprocess,         //PreprocessingHandler::process
+        AddPoint,           //Experiment::addPoint
+        PlotUpdate,         //adding the point to the live plot
+        AddPhoto,           //Experiment::addPhoto
+        Count
+    };
+
+    enum class Counter {
+        Packets = 0,        //datagrams received
+        Bytes,              //bytes received
+        Drops,              //datagrams thrown away (malformed, too short...)
+        Stored,             //frames written into the database
+        Photos,
+        Count
+    };
+
+    enum class Gauge {
+        ReceiveQueue = 0,   //frames waiting between receiving and storing
+        WriteQueue,         //frames of the open capture transaction, not committed yet
+        Count
+    };
+
+    static constexpr std::array<const char*, static_cast<size_t>(Stage::Count)> stageNames {
+        "collect", "preprocess", "add_point", "plot_update", "add_photo"
+    };
+    static constexpr std::array<const char*, static_cast<size_t>(Counter::Count)> counterNames {
+        "packets", "bytes", "drops", "stored", "photos"
+    };
+    static constexpr std::array<const char*, static_cast<size_t>(Gauge::Count)> gaugeNames {
+        "receive_queue", "write_queue"
+    };
+
+    static Metrics& getInstance() {
+        static Metrics m;
+        return m;
+    }
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(Stage stage, uint64_t startNs) {
+        stages[static_cast<size_t>(stage)].record(now() - startNs);
+    }
+
+    void add(Counter counter, uint64_t value = 1) {
+        counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void set(Gauge gauge, int64_t value) {
+        gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed);
+    }
+
+    const LatencyHistogram& getHistogram(Stage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+
+    uint64_t get(Counter counter) const {
+        return counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+
+    int64_t get(Gauge gauge) const {
+        return gauges[static_cast<size_t>(gauge)].load(std::memory_order_relaxed);
+    }
+
+    class ScopedTimer {
+    public:
+        ScopedTimer(Stage stage) :
+            stage(stage),
+            start(Metrics::now())
+        {}
+
+        ~ScopedTimer() {
+            Metrics::getInstance().record(stage, start);
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Stage stage;
+        uint64_t start;
+    };
+
+    //Point in time view of all metrics. Rates are computed against the
+    //previous snapshot passed in, so every consumer keeps its own one.
+    struct Snapshot {
+        struct StageInfo {
+            uint64_t count = 0;
+            double mean = 0;
+            uint64_t p50 = 0;
+            uint64_t p90 = 0;
+            uint64_t p99 = 0;
+            uint64_t p999 = 0;
+            uint64_t max = 0;
+        };
+
+        uint64_t timeNs = 0;
+        std::array<StageInfo, static_cast<size_t>(Stage::Count)> stages;
+        std::array<uint64_t, static_cast<size_t>(Counter::Count)> counters {};
+        std::array<int64_t, static_cast<size_t>(Gauge::Count)> gauges {};
+        std::array<double, static_cast<size_t>(Counter::Count)> rates {};   //per second
+
+        nlohmann::json toJson() const {
+            nlohmann::json js;
+            js["time_ns"] = timeNs;
+            for(size_t i = 0; i < stages.size(); i++) {
+                const StageInfo& s = stages[i];
+                js["stages"][stageNames[i]] = {
+                    {"count", s.count}, {"mean_ns", s.mean}, {"p50_ns", s.p50}, {"p90_ns", s.p90},
+                    {"p99_ns", s.p99}, {"p999_ns", s.p999}, {"max_ns", s.max}
+                };
+            }
+            for(size_t i = 0; i < counters.size(); i++) {
+                js["counters"][counterNames[i]] = counters[i];
+                js["rates"][std::string(counterNames[i]) + "_per_s"] = rates[i];
+            }
+            for(size_t i = 0; i < gauges.size(); i++) {
+                js["gauges"][gaugeNames[i]] = gauges[i];
+            }
+            return js;
+        }
+
+        std::string toPrometheus() const {
+            std::ostringstream out;
+            out << "# TYPE csi_stage_latency_seconds summary\n";
+            for(size_t i = 0; i < stages.size(); i++) {
+                const StageInfo& s = stages[i];
+                std::string label = std::string("stage=\"") + stageNames[i] + "\"";
+                out << "csi_stage_latency_seconds{" << label << ",quantile=\"0.5\"} " << s.p50 * 1e-9 << "\n"
+                    << "csi_stage_latency_seconds{" << label << ",quantile=\"0.9\"} " << s.p90 * 1e-9 << "\n"
+                    << "csi_stage_latency_seconds{" << label << ",quantile=\"0.99\"} " << s.p99 * 1e-9 << "\n"
+                    << "csi_stage_latency_seconds{" << label << ",quantile=\"0.999\"} " << s.p999 * 1e-9 << "\n"
+                    << "csi_stage_latency_seconds_sum{" << label << "} " << s.mean * s.count * 1e-9 << "\n"
+                    << "csi_stage_latency_seconds_count{" << label << "} " << s.count << "\n";
+            }
+            for(size_t i = 0; i < counters.size(); i++) {
+                out << "# TYPE csi_" << counterNames[i] << "_total counter\n"
+                    << "csi_" << counterNames[i] << "_total " << counters[i] << "\n";
+            }
+            for(size_t i = 0; i < gauges.size(); i++) {
+                out << "# TYPE csi_" << gaugeNames[i] << " gauge\n"
+                    << "csi_" << gaugeNames[i] << " " << gauges[i] << "\n";
+            }
+            return out.str();
+        }
+
+        std::string toText() const {
+            std::ostringstream out;
+            out.precision(1);
+            out << std::fixed;
+            out << "stage          count       mean us    p50 us    p99 us  p99.9 us    max us\n";
+            for(size_t i = 0; i < stages.size(); i++) {
+                const StageInfo& s = stages[i];
+                out.width(12);
+                out << std::left << stageNames[i] << std::right;
+                out.width(9);  out << s.count;
+                out.width(12); out << s.mean / 1e3;
+                out.width(10); out << s.p50 / 1e3;
+                out.width(10); out << s.p99 / 1e3;
+                out.width(10); out << s.p999 / 1e3;
+                out.width(10); out << s.max / 1e3;
+                out << "\n";
+            }
+            out << "\n";
+            for(size_t i = 0; i < counters.size(); i++) {
+                out << counterNames[i] << ": " << counters[i] << " (" << rates[i] << "/s)\n";
+            }
+            for(size_t i = 0; i < gauges.size(); i++) {
+                out << gaugeNames[i] << ": " << gauges[i] << "\n";
+            }
+            return out.str();
+        }
+    };
+
+    Snapshot snapshot(const Snapshot* previous = nullptr) const {
+        Snapshot snap;
+        snap.timeNs = now();
+        for(size_t i = 0; i < stages.size(); i++) {
+            const LatencyHistogram& h = stages[i];
+            Snapshot::StageInfo& s = snap.stages[i];
+            s.count = h.getCount();
+            s.mean = s.count ? static_cast<double>(h.getSum()) / s.count : 0;
+            s.p50 = h.percentile(0.5);
+            s.p90 = h.percentile(0.9);
+            s.p99 = h.percentile(0.99);
+            s.p999 = h.percentile(0.999);
+            s.max = h.getMax();
+        }
+        for(size_t i = 0; i < counters.size(); i++) {
+            snap.counters[i] = counters[i].load(std::memory_order_relaxed);
+        }
+        for(size_t i = 0; i < gauges.size(); i++) {
+            snap.gauges[i] = gauges[i].load(std::memory_order_relaxed);
+        }
+
+        if(previous && snap.timeNs > previous->timeNs) {
+            double seconds = (snap.timeNs - previous->timeNs) * 1e-9;
+            for(size_t i = 0; i < counters.size(); i++) {
+                snap.rates[i] = (snap.counters[i] - previous->counters[i]) / seconds;
+            }
+        }
+        return snap;
+    }
+
+private:
+    std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> stages;
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)> counters {};
+    std::array<std::atomic<int64_t>, static_cast<size_t>(Gauge::Count)> gauges {};
+
+    Metrics() = default;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "metrics.hpp"
+
+#include <string>
+#include <optional>
+#include <cstdlib>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+//Periodically exports Metrics snapshots, either by rewriting a file
+//(written aside and renamed, so readers never see a partial file) or by
+//serving the latest snapshot to every client that connects to a unix socket.
+class MetricsExporter {
+public:
+
+    enum class Format {
+        Json,
+        Prometheus
+    };
+
+    struct Settings {
+        std::string target;         //file path or "unix:/path/to/socket"
+        Format format = Format::Json;
+        double interval = 5;        //seconds
+    };
+
+    MetricsExporter() = default;
+
+    MetricsExporter(Settings settings) {
+        start(settings);
+    }
+
+    ~MetricsExporter() {
+        stop();
+    }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    //reads DBC_METRICS_EXPORT, DBC_METRICS_FORMAT (json|prometheus) and DBC_METRICS_INTERVAL
+    static std::optional<Settings> settingsFromEnv() {
+        const char* target = std::getenv("DBC_METRICS_EXPORT");
+        if(target == nullptr || *target == '\0')
+            return std::nullopt;
+
+        Settings settings;
+        settings.target = target;
+        const char* format = std::getenv("DBC_METRICS_FORMAT");
+        if(format && std::string(format) == "prometheus")
+            settings.format = Format::Prometheus;
+        const char* interval = std::getenv("DBC_METRICS_INTERVAL");
+        if(interval) {
+            try {
+                settings.interval = std::stod(interval);
+            }
+            catch(...) {
+                std::cerr << "MetricsExporter: incorrect DBC_METRICS_INTERVAL " << interval << std::endl;
+            }
+        }
+        return settings;
+    }
+
+    void start(Settings newSettings) {
+        stop();
+        settings = newSettings;
+        if(settings.target.rfind(unixPrefix, 0) == 0) {
+            if(!openSocket(settings.target.substr(std::strlen(unixPrefix))))
+                return;
+        }
+        worker = std::jthread([this](std::stop_token stoken) { work(stoken); });
+    }
+
+    void stop() {
+        if(worker.joinable()) {
+            worker.request_stop();
+            worker.join();
+        }
+        if(listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+            std::filesystem::remove(socketPath);
+        }
+    }
+
+private:
+    static constexpr const char* unixPrefix = "unix:";
+
+    Settings settings;
+    std::jthread worker;
+    int listenFd = -1;
+    std::string socketPath;
+    std::string latest;
+
+    bool openSocket(const std::string& path) {
+        sockaddr_un addr {};
+        if(path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "MetricsExporter: socket path is too long " << path << std::endl;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        std::filesystem::remove(path);
+        if(listenFd < 0 ||
+           bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+           listen(listenFd, 4) != 0)
+        {
+            std::cerr << "MetricsExporter: unable to listen on " << path << ": " << std::strerror(errno) << std::endl;
+            if(listenFd >= 0)
+                close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        socketPath = path;
+        return true;
+    }
+
+    std::string render(const Metrics::Snapshot& snap) const {
+        if(settings.format == Format::Prometheus)
+            return snap.toPrometheus();
+        return snap.toJson().dump() + "\n";
+    }
+
+    void writeFile() {
+        std::filesystem::path path(settings.target);
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp);
+            if(!out) {
+                std::cerr << "MetricsExporter: unable to write " << tmp << std::endl;
+                return;
+            }
+            out << latest;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+    }
+
+    void serveClients(int timeoutMs) {
+        pollfd pfd {listenFd, POLLIN, 0};
+        if(poll(&pfd, 1, timeoutMs) <= 0)
+            return;
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(client < 0)
+            return;
+        size_t sent = 0;
+        while(sent < latest.size()) {
+            ssize_t n = send(client, latest.data() + sent, latest.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0)
+                break;
+            sent += n;
+        }
+        close(client);
+    }
+
+    void work(std::stop_token stoken) {
+        using clock = std::chrono::steady_clock;
+        const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(settings.interval));
+        Metrics::Snapshot previous = Metrics::getInstance().snapshot();
+        auto nextExport = clock::now();
+
+        while(!stoken.stop_requested()) {
+            if(clock::now() >= nextExport) {
+                Metrics::Snapshot snap = Metrics::getInstance().snapshot(&previous);
+                latest = render(snap);
+                previous = snap;
+                if(listenFd < 0)
+                    writeFile();
+                nextExport += period;
+            }
+
+            if(listenFd >= 0)
+                serveClients(200);
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <SQLiteCpp/SQLiteCpp.h>
+#include "sql_qualify.hpp"
+
+//Precise packet times.
+//
+//Every packet keeps the host receive time in nanoseconds and the TSF
+//(hardware timestamp of the NIC, microseconds) as offsets: the host time
+//from the first packet of its experiment (time_base), the TSF from the
+//first packet of its source (tsf_base), every NIC runs a TSF clock of its
+//own. Offsets of an experiment fit into a few bytes of SQLite varint
+//instead of eight, and (experiment_id, host_ns_off) is indexed, so ordering
+//and time windows don't need the whole row. packet.timestamp stays in
+//seconds for rollups and filters. Both tables live next to the packets,
+//see qualifySql. time_base.tsf is left from older versions and is NULL.
+namespace PacketTime {
+
+constexpr int64_t nsPerSecond = 1000000000;
+
+struct Base {
+    int64_t hostNs = 0;
+    std::map<uint16_t, int64_t> tsf;    //by packet.source_id
+
+    std::optional<int64_t> tsfOf(uint16_t sourceId) const {
+        auto it = tsf.find(sourceId);
+        if(it == tsf.end())
+            return std::nullopt;
+        return it->second;
+    }
+};
+
+inline std::optional<Base> load(SQLite::Database& db, int32_t expId, const std::string& schema) {
+    SQLite::Statement query(db, qualifySql("SELECT host_ns FROM data.time_base WHERE experiment_id = @exp_id", schema));
+    query.bind("@exp_id", expId);
+    if(!query.executeStep())
+        return std::nullopt;
+    Base base;
+    base.hostNs = query.getColumn(0).getInt64();
+
+    SQLite::Statement tsfQuery(db, qualifySql("SELECT source_id, tsf FROM data.tsf_base WHERE experiment_id = @exp_id", schema));
+    tsfQuery.bind("@exp_id", expId);
+    while(tsfQuery.executeStep())
+        base.tsf[tsfQuery.getColumn(0).getInt()] = tsfQuery.getColumn(1).getInt64();
+    return base;
+}
+
+inline void storeHost(SQLite::Database& db, int32_t expId, const std::string& schema, int64_t hostNs) {
+    SQLite::Statement query(db, qualifySql("INSERT OR REPLACE INTO data.time_base (experiment_id, host_ns) VALUES (@exp_id, @host_ns)", schema));
+    query.bind("@exp_id", expId);
+    query.bind("@host_ns", hostNs);
+    query.exec();
+}
+
+inline void storeTsf(SQLite::Database& db, int32_t expId, const std::string& schema, uint16_t sourceId, int64_t tsf) {
+    SQLite::Statement query(db, qualifySql("INSERT OR REPLACE INTO data.tsf_base (experiment_id, source_id, tsf) VALUES (@exp_id, @source_id, @tsf)", schema));
+    query.bind("@exp_id", expId);
+    query.bind("@source_id", sourceId);
+    query.bind("@tsf", tsf);
+    query.exec();
+}
+
+//Fills host_ns_off of packets that only have a timestamp in seconds
+//(older databases, import), the order within a second is kept by id
+inline void backfill(SQLite::Database& db, int32_t expId, const std::string& schema = "main") {
+    SQLite::Statement base(db, qualifySql(R"asd(
+        INSERT OR IGNORE INTO data.time_base (experiment_id, host_ns)
+        SELECT @exp_id, first FROM (
+            SELECT MIN(timestamp) * @ns AS first FROM data.packet
+            WHERE experiment_id = @exp_id AND timestamp IS NOT NULL
+        ) WHERE first IS NOT NULL
+    )asd", schema));
+    base.bind("@exp_id", expId);
+    base.bind("@ns", nsPerSecond);
+    base.exec();
+
+    SQLite::Statement offsets(db, qualifySql(R"asd(
+        UPDATE data.packet SET
+            host_ns_off = timestamp * @ns - (SELECT host_ns FROM data.time_base WHERE experiment_id = @exp_id)
+        WHERE experiment_id = @exp_id AND host_ns_off IS NULL AND timestamp IS NOT NULL
+    )asd", schema));
+    offsets.bind("@exp_id", expId);
+    offsets.bind("@ns", nsPerSecond);
+    offsets.exec();
+}
+
+//Moves the single TSF base of time_base (older versions) to tsf_base.
+//Every source gets the TSF of its first packet as the base and its offsets
+//are rebased on it, the raw TSF values are kept as they were
+inline void splitTsfBase(SQLite::Database& db, const std::string& schema = "main") {
+    db.exec(qualifySql(R"asd(
+        INSERT OR IGNORE INTO data.tsf_base (experiment_id, source_id, tsf)
+        SELECT packet.experiment_id, packet.source_id, time_base.tsf + packet.tsf_off
+        FROM data.packet
+        INNER JOIN data.time_base ON time_base.experiment_id = packet.experiment_id
+        WHERE time_base.tsf IS NOT NULL AND packet.id IN (
+            SELECT MIN(id) FROM data.packet WHERE tsf_off IS NOT NULL GROUP BY experiment_id, source_id
+        )
+    )asd", schema));
+    db.exec(qualifySql(R"asd(
+        UPDATE data.packet SET
+            tsf_off = tsf_off
+                + (SELECT tsf FROM data.time_base WHERE time_base.experiment_id = packet.experiment_id)
+                - (SELECT tsf FROM data.tsf_base WHERE tsf_base.experiment_id = packet.experiment_id AND tsf_base.source_id = packet.source_id)
+        WHERE tsf_off IS NOT NULL
+    )asd", schema));
+    db.exec(qualifySql("UPDATE data.time_base SET tsf = NULL", schema));
+}
+
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include "preprocessors.hpp"
+
+//Sliding-window PCA of the amplitude of all (rx, tx, subcarrier) streams.
+//
+//The window is kept as running sums: the sum of frames and the scatter
+//matrix sum(x * x^T). New and evicted frames are queued and folded into the
+//scatter matrix every update frames as one blocked rank-2*update update,
+//and then the top components are refined with a couple of warm-started
+//subspace iterations. Every frame is projected onto the current components,
+//the emitted frame is [1][1][components] with offset + projection in first
+//and 0 in second. Frames before the first fit are skipped.
+//
+//The sign of a component is arbitrary, it's fixed so that the weights of
+//the component sum to a positive value and doesn't flip between updates.
+//Stored values go through the amplitude/phase trigger, so the amplitude
+//view shows |offset + projection|: with offset 0 the sign is lost there and
+//only survives as phase 0 or pi, with an offset above the spread of the
+//projections the amplitude is the projection shifted by offset. The real
+//part keeps offset + projection exactly.
+//
+//Settings: "pca": {"components": 3, "window": 256, "update": 16, "offset": 0}
+class PcaReducer : public PreprocessingHandler {
+public:
+    static constexpr size_t blockSize = 64;
+    static constexpr size_t iterationsPerUpdate = 2;
+    static constexpr size_t rebuildPeriod = 64;      //in windows
+
+    Glib::ustring getName() const override {
+        return "Метод главных компонент";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        components = std::clamp<size_t>(getDefault(config["pca"], "components", components), 1, 64);
+        window = std::clamp<size_t>(getDefault(config["pca"], "window", window), 2, 1 << 16);
+        update = std::clamp<size_t>(getDefault(config["pca"], "update", update), 1, window);
+        offset = getDefault(config["pca"], "offset", offset);
+        reset();
+    }
+
+    void reset() override {
+        dims = 0;
+    }
+
+    std::optional<HandlerBase::datatype> process(const HandlerBase::datatype& toProcess, const FrameInfo& = FrameInfo()) override {
+        if(!frame.load(toProcess) || frame.streams() == 0)
+            return std::nullopt;
+        if(frame.streams() != dims)
+            resize(frame.streams());
+        frame.computeAmplitude();
+        push(frame.ampl.data());
+
+        if(pendingCount == update) {
+            foldPending();
+            if(count > components) {
+                for(size_t it = 0; it < iterationsPerUpdate; it++)
+                    iterate();
+                fixSigns();
+                fitted = true;
+            }
+        }
+        if(!fitted)
+            return std::nullopt;
+
+        HandlerBase::datatype result;
+        result.first.assign(1, std::vector<std::vector<double>>(1, std::vector<double>(components, 0.0)));
+        result.second = result.first;
+        project(frame.ampl.data(), result.first[0][0].data());
+        for(double& value : result.first[0][0])
+            value += offset;
+        return result;
+    }
+
+private:
+    size_t components = 3;
+    size_t window = 256;
+    size_t update = 16;
+    double offset = 0;
+
+    FlatFrame frame;
+    size_t dims = 0;
+    size_t pos = 0;
+    size_t filled = 0;
+    size_t count = 0;               //frames folded into the sums
+    bool fitted = false;
+
+    std::vector<double> history;    //window x dims
+    std::vector<double> added;      //update x dims, waiting to be folded in
+    std::vector<double> evicted;    //update x dims, waiting to be folded out
+    size_t pendingCount = 0;
+    size_t pendingEvicted = 0;
+    size_t framesSinceRebuild = 0;
+
+    std::vector<double> sum;        //dims
+    std::vector<double> scatter;    //dims x dims
+    std::vector<double> mean;       //dims
+    std::vector<double> basis;      //components x dims, orthonormal rows
+    std::vector<double> product;    //components x dims
+
+    void resize(size_t newDims) {
+        dims = newDims;
+        history.assign(window * dims, 0.0);
+        added.assign(update * dims, 0.0);
+        evicted.assign(update * dims, 0.0);
+        sum.assign(dims, 0.0);
+        scatter.assign(dims * dims, 0.0);
+        mean.assign(dims, 0.0);
+        product.assign(components * dims, 0.0);
+        pos = 0;
+        filled = 0;
+        count = 0;
+        pendingCount = 0;
+        pendingEvicted = 0;
+        framesSinceRebuild = 0;
+        fitted = false;
+
+        //deterministic start, any basis not orthogonal to the solution works
+        basis.assign(components * dims, 0.0);
+        for(size_t c = 0; c < components; c++) {
+            for(size_t i = 0; i < dims; i++) {
+                basis[c * dims + i] = std::cos(0.7 * (c + 1) * i + c);
+            }
+        }
+        orthonormalize(basis);
+    }
+
+    void push(const double* x) {
+        double* slot = history.data() + pos * dims;
+        if(filled == window) {
+            std::copy(slot, slot + dims, evicted.begin() + pendingEvicted * dims);
+            pendingEvicted++;
+        }
+        else {
+            filled++;
+        }
+        std::copy(x, x + dims, slot);
+        std::copy(x, x + dims, added.begin() + pendingCount * dims);
+        pendingCount++;
+        pos = (pos + 1) % window;
+    }
+
+    void foldPending() {
+        framesSinceRebuild += pendingCount;
+        if(framesSinceRebuild >= rebuildPeriod * window) {
+            //adding and removing frames accumulates rounding errors, start over from the window
+            std::fill(scatter.begin(), scatter.end(), 0.0);
+            std::fill(sum.begin(), sum.end(), 0.0);
+            rankUpdate(history.data(), filled, 1.0);
+            count = filled;
+            framesSinceRebuild = 0;
+        }
+        else {
+            rankUpdate(added.data(), pendingCount, 1.0);
+            rankUpdate(evicted.data(), pendingEvicted, -1.0);
+            count += pendingCount - pendingEvicted;
+        }
+        pendingCount = 0;
+        pendingEvicted = 0;
+
+        const double norm = 1.0 / count;
+        for(size_t i = 0; i < dims; i++) {
+            mean[i] = sum[i] * norm;
+        }
+    }
+
+    //scatter += sign * rows^T * rows, blocked so that a block of the
+    //scatter matrix stays in cache while all rows pass through it
+    void rankUpdate(const double* rows, size_t n, double sign) {
+        for(size_t ib = 0; ib < dims; ib += blockSize) {
+            const size_t ie = std::min(ib + blockSize, dims);
+            for(size_t jb = 0; jb < dims; jb += blockSize) {
+                const size_t je = std::min(jb + blockSize, dims);
+                for(size_t b = 0; b < n; b++) {
+                    const double* __restrict x = rows + b * dims;
+                    for(size_t i = ib; i < ie; i++) {
+                        const double xi = sign * x[i];
+                        double* __restrict row = scatter.data() + i * dims;
+#pragma omp simd
+                        for(size_t j = jb; j < je; j++) {
+                            row[j] += xi * x[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        double* __restrict s = sum.data();
+        for(size_t b = 0; b < n; b++) {
+            const double* __restrict x = rows + b * dims;
+#pragma omp simd
+            for(size_t i = 0; i < dims; i++) {
+                s[i] += sign * x[i];
+            }
+        }
+    }
+
+    //basis = orth(cov * basis), cov = scatter / count - mean * mean^T
+    void iterate() {
+        const double norm = 1.0 / count;
+        std::fill(product.begin(), product.end(), 0.0);
+        for(size_t ib = 0; ib < dims; ib += blockSize) {
+            const size_t ie = std::min(ib + blockSize, dims);
+            for(size_t c = 0; c < components; c++) {
+                const double* __restrict q = basis.data() + c * dims;
+                double* __restrict z = product.data() + c * dims;
+                for(size_t i = ib; i < ie; i++) {
+                    const double* __restrict row = scatter.data() + i * dims;
+                    double acc = 0;
+#pragma omp simd reduction(+:acc)
+                    for(size_t j = 0; j < dims; j++) {
+                        acc += row[j] * q[j];
+                    }
+                    z[i] = acc * norm;
+                }
+            }
+        }
+        for(size_t c = 0; c < components; c++) {
+            const double* __restrict q = basis.data() + c * dims;
+            double* __restrict z = product.data() + c * dims;
+            double mq = 0;
+#pragma omp simd reduction(+:mq)
+            for(size_t i = 0; i < dims; i++) {
+                mq += mean[i] * q[i];
+            }
+#pragma omp simd
+            for(size_t i = 0; i < dims; i++) {
+                z[i] -= mean[i] * mq;
+            }
+        }
+        orthonormalize(product);
+        basis.swap(product);
+    }
+
+    //flips every component whose weights sum to a negative value
+    void fixSigns() {
+        for(size_t c = 0; c < components; c++) {
+            double* __restrict q = basis.data() + c * dims;
+            double total = 0;
+#pragma omp simd reduction(+:total)
+            for(size_t i = 0; i < dims; i++) {
+                total += q[i];
+            }
+            if(total >= 0)
+                continue;
+#pragma omp simd
+            for(size_t i = 0; i < dims; i++) {
+                q[i] = -q[i];
+            }
+        }
+    }
+
+    //modified Gram-Schmidt over the rows, degenerate rows are replaced by a unit vector
+    void orthonormalize(std::vector<double>& rows) const {
+        for(size_t c = 0; c < components; c++) {
+            double* __restrict v = rows.data() + c * dims;
+            for(size_t p = 0; p < c; p++) {
+                const double* __restrict u = rows.data() + p * dims;
+                double d = 0;
+#pragma omp simd reduction(+:d)
+                for(size_t i = 0; i < dims; i++) {
+                    d += u[i] * v[i];
+                }
+#pragma omp simd
+                for(size_t i = 0; i < dims; i++) {
+                    v[i] -= d * u[i];
+                }
+            }
+            double len = 0;
+#pragma omp simd reduction(+:len)
+            for(size_t i = 0; i < dims; i++) {
+                len += v[i] * v[i];
+            }
+            len = std::sqrt(len);
+            if(len < 1e-12) {
+                std::fill(v, v + dims, 0.0);
+                v[c % dims] = 1;
+                continue;
+            }
+#pragma omp simd
+            for(size_t i = 0; i < dims; i++) {
+                v[i] /= len;
+            }
+        }
+    }
+
+    void project(const double* x, double* out) const {
+        for(size_t c = 0; c < components; c++) {
+            const double* __restrict q = basis.data() + c * dims;
+            double acc = 0;
+#pragma omp simd reduction(+:acc)
+            for(size_t i = 0; i < dims; i++) {
+                acc += q[i] * (x[i] - mean[i]);
+            }
+            out[c] = acc;
+        }
+    }
+};
@@ -0,0 +1,446 @@
+#pragma once
+
+#include "handler_base.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//Built-in preprocessors registered in HandlersList.
+//
+//Every frame is flattened into contiguous structure-of-arrays buffers
+//(stream index = (rx * nc + tx) * subcarriers + subcarrier) and the filters
+//run as straight loops over all streams at once, which the compiler turns
+//into SIMD code (#pragma omp simd, built with -fopenmp-simd).
+//Per-stream history is kept in the same layout: slot-major, stream-minor.
+//
+//Settings are read from the experiment config, every filter has its own section:
+//  "hampel":     {"window": 7, "threshold": 3}
+//  "moving_avg": {"window": 5}
+//  "ewma":       {"alpha": 0.3}
+//  "phase":      {"indices": [-28, ..., 28]}     (optional subcarrier indices)
+//  "rssi_norm":  {"per_chain": true}
+
+struct FlatFrame {
+    size_t nr = 0;
+    size_t nc = 0;
+    size_t ns = 0;
+    std::vector<double> re;
+    std::vector<double> im;
+    std::vector<double> ampl;
+
+    size_t streams() const {
+        return nr * nc * ns;
+    }
+
+    //returns false for frames that aren't rectangular
+    bool load(const HandlerBase::datatype& data) {
+        nr = data.first.size();
+        nc = nr ? data.first[0].size() : 0;
+        ns = nc ? data.first[0][0].size() : 0;
+        if(data.second.size() != nr)
+            return false;
+
+        re.resize(streams());
+        im.resize(streams());
+        size_t s = 0;
+        for(size_t r = 0; r < nr; r++) {
+            if(data.first[r].size() != nc || data.second[r].size() != nc)
+                return false;
+            for(size_t c = 0; c < nc; c++) {
+                if(data.first[r][c].size() != ns || data.second[r][c].size() != ns)
+                    return false;
+                std::copy(data.first[r][c].begin(), data.first[r][c].end(), re.begin() + s);
+                std::copy(data.second[r][c].begin(), data.second[r][c].end(), im.begin() + s);
+                s += ns;
+            }
+        }
+        return true;
+    }
+
+    void store(HandlerBase::datatype& data) const {
+        size_t s = 0;
+        for(size_t r = 0; r < nr; r++) {
+            for(size_t c = 0; c < nc; c++) {
+                std::copy(re.begin() + s, re.begin() + s + ns, data.first[r][c].begin());
+                std::copy(im.begin() + s, im.begin() + s + ns, data.second[r][c].begin());
+                s += ns;
+            }
+        }
+    }
+
+    void computeAmplitude() {
+        const size_t n = streams();
+        ampl.resize(n);
+        const double* __restrict pr = re.data();
+        const double* __restrict pi = im.data();
+        double* __restrict pa = ampl.data();
+#pragma omp simd
+        for(size_t i = 0; i < n; i++) {
+            pa[i] = std::sqrt(pr[i] * pr[i] + pi[i] * pi[i]);
+        }
+    }
+
+    //replaces amplitudes with newAmpl keeping the phase, computeAmplitude() must be called before
+    void applyAmplitude(const double* __restrict newAmpl) {
+        const size_t n = streams();
+        double* __restrict pr = re.data();
+        double* __restrict pi = im.data();
+        const double* __restrict pa = ampl.data();
+#pragma omp simd
+        for(size_t i = 0; i < n; i++) {
+            double scale = pa[i] > 0 ? newAmpl[i] / pa[i] : 0.0;
+            pr[i] *= scale;
+            pi[i] *= scale;
+        }
+    }
+};
+
+namespace kernels {
+
+inline void compareSwap(double* __restrict a, double* __restrict b, size_t n) {
+#pragma omp simd
+    for(size_t i = 0; i < n; i++) {
+        double lo = a[i] < b[i] ? a[i] : b[i];
+        double hi = a[i] < b[i] ? b[i] : a[i];
+        a[i] = lo;
+        b[i] = hi;
+    }
+}
+
+//sorts every column of a rows x n slot-major matrix with a sorting network,
+//so all columns are sorted at once with vector min/max
+inline void sortColumns(double* data, size_t rows, size_t n) {
+    for(size_t i = 0; i + 1 < rows; i++) {
+        for(size_t j = 0; j + 1 < rows - i; j++) {
+            compareSwap(data + j * n, data + (j + 1) * n, n);
+        }
+    }
+}
+
+}
+
+//Base for filters that keep state per stream. The state is (re)allocated
+//whenever the frame shape changes and after reset()
+class StreamPreprocessor : public PreprocessingHandler {
+public:
+    std::optional<HandlerBase::datatype> process(const HandlerBase::datatype& toProcess, const FrameInfo& info = FrameInfo()) override {
+        if(!frame.load(toProcess) || frame.streams() == 0)
+            return toProcess;
+        if(frame.streams() != streams || frame.ns != subcarriers) {
+            streams = frame.streams();
+            subcarriers = frame.ns;
+            resize(streams);
+        }
+
+        processFrame(frame, info);
+
+        HandlerBase::datatype result = toProcess;
+        frame.store(result);
+        return result;
+    }
+
+    void reset() override {
+        streams = 0;
+    }
+
+protected:
+    FlatFrame frame;
+    size_t streams = 0;
+    size_t subcarriers = 0;
+
+    virtual void resize(size_t streams) = 0;
+    virtual void processFrame(FlatFrame& frame, const FrameInfo& info) = 0;
+};
+
+//Replaces amplitude outliers by the median of the last window frames.
+//A sample is an outlier if it's farther than threshold * 1.4826 * MAD from the median
+class HampelFilter : public StreamPreprocessor {
+public:
+    Glib::ustring getName() const override {
+        return "Фильтр Хампеля";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        window = std::clamp<size_t>(getDefault(config["hampel"], "window", window), 3, 31) | 1;
+        threshold = getDefault(config["hampel"], "threshold", threshold);
+        reset();
+    }
+
+protected:
+    size_t window = 7;
+    double threshold = 3;
+
+    std::vector<double> history;    //window x streams
+    std::vector<double> sorted;     //window x streams
+    std::vector<double> median;
+    std::vector<double> result;
+    size_t pos = 0;
+    size_t filled = 0;
+
+    void resize(size_t streams) override {
+        history.assign(window * streams, 0.0);
+        sorted.resize(window * streams);
+        median.resize(streams);
+        result.resize(streams);
+        pos = 0;
+        filled = 0;
+    }
+
+    void processFrame(FlatFrame& frame, const FrameInfo&) override {
+        const size_t n = streams;
+        frame.computeAmplitude();
+        std::copy(frame.ampl.begin(), frame.ampl.end(), history.begin() + pos * n);
+        pos = (pos + 1) % window;
+        filled = std::min(filled + 1, window);
+        if(filled < window)
+            return;
+
+        std::copy(history.begin(), history.end(), sorted.begin());
+        kernels::sortColumns(sorted.data(), window, n);
+        std::copy(sorted.begin() + (window / 2) * n, sorted.begin() + (window / 2 + 1) * n, median.begin());
+
+        const double* __restrict med = median.data();
+        for(size_t w = 0; w < window; w++) {
+            double* __restrict dev = sorted.data() + w * n;
+            const double* __restrict h = history.data() + w * n;
+#pragma omp simd
+            for(size_t i = 0; i < n; i++) {
+                dev[i] = std::abs(h[i] - med[i]);
+            }
+        }
+        kernels::sortColumns(sorted.data(), window, n);
+        const double* __restrict mad = sorted.data() + (window / 2) * n;
+
+        const double k = threshold * 1.4826;
+        const double* __restrict a = frame.ampl.data();
+        double* __restrict out = result.data();
+#pragma omp simd
+        for(size_t i = 0; i < n; i++) {
+            out[i] = std::abs(a[i] - med[i]) > k * mad[i] ? med[i] : a[i];
+        }
+        frame.applyAmplitude(out);
+    }
+};
+
+//Mean amplitude of the last window frames
+class MovingAverageFilter : public StreamPreprocessor {
+public:
+    Glib::ustring getName() const override {
+        return "Скользящее среднее";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        window = std::clamp<size_t>(getDefault(config["moving_avg"], "window", window), 1, 1024);
+        reset();
+    }
+
+protected:
+    size_t window = 5;
+
+    std::vector<double> history;    //window x streams
+    std::vector<double> sum;
+    std::vector<double> result;
+    size_t pos = 0;
+    size_t filled = 0;
+
+    void resize(size_t streams) override {
+        history.assign(window * streams, 0.0);
+        sum.assign(streams, 0.0);
+        result.resize(streams);
+        pos = 0;
+        filled = 0;
+    }
+
+    void processFrame(FlatFrame& frame, const FrameInfo&) override {
+        const size_t n = streams;
+        frame.computeAmplitude();
+        filled = std::min(filled + 1, window);
+        const double norm = 1.0 / filled;
+
+        double* __restrict old = history.data() + pos * n;
+        double* __restrict s = sum.data();
+        double* __restrict out = result.data();
+        const double* __restrict a = frame.ampl.data();
+#pragma omp simd
+        for(size_t i = 0; i < n; i++) {
+            s[i] += a[i] - old[i];
+            old[i] = a[i];
+            out[i] = s[i] * norm;
+        }
+        pos = (pos + 1) % window;
+        frame.applyAmplitude(out);
+    }
+};
+
+//Exponentially weighted moving average of amplitude
+class EwmaFilter : public StreamPreprocessor {
+public:
+    Glib::ustring getName() const override {
+        return "Экспоненциальное сглаживание";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        alpha = std::clamp(getDefault(config["ewma"], "alpha", alpha), 0.0, 1.0);
+        reset();
+    }
+
+protected:
+    double alpha = 0.3;
+
+    std::vector<double> state;
+    bool initialized = false;
+
+    void resize(size_t streams) override {
+        state.assign(streams, 0.0);
+        initialized = false;
+    }
+
+    void processFrame(FlatFrame& frame, const FrameInfo&) override {
+        const size_t n = streams;
+        frame.computeAmplitude();
+        if(!initialized) {
+            std::copy(frame.ampl.begin(), frame.ampl.end(), state.begin());
+            initialized = true;
+            return;
+        }
+
+        double* __restrict st = state.data();
+        const double* __restrict a = frame.ampl.data();
+        const double keep = 1.0 - alpha;
+#pragma omp simd
+        for(size_t i = 0; i < n; i++) {
+            st[i] = alpha * a[i] + keep * st[i];
+        }
+        frame.applyAmplitude(st);
+    }
+};
+
+//Unwraps phase across subcarriers of every link and removes the linear
+//component (sampling time and frequency offsets) with a least squares fit
+class PhaseSanitizer : public StreamPreprocessor {
+public:
+    Glib::ustring getName() const override {
+        return "Санитизация фазы";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        indices.clear();
+        try {
+            if(config["phase"]["indices"].is_array())
+                indices = config["phase"]["indices"].get<std::vector<double>>();
+        }
+        catch(const nlohmann::json::exception& ex) {}
+        reset();
+    }
+
+protected:
+    std::vector<double> indices;    //physical subcarrier indices, 0..ns-1 if empty
+    std::vector<double> x;
+    std::vector<double> phase;
+
+    void resize(size_t streams) override {
+        x.resize(subcarriers);
+        for(size_t k = 0; k < subcarriers; k++) {
+            x[k] = indices.size() == subcarriers ? indices[k] : static_cast<double>(k);
+        }
+        phase.resize(streams);
+    }
+
+    void processFrame(FlatFrame& frame, const FrameInfo&) override {
+        const size_t ns = subcarriers;
+        frame.computeAmplitude();
+        for(size_t i = 0; i < streams; i++) {
+            phase[i] = std::atan2(frame.im[i], frame.re[i]);
+        }
+
+        double meanX = 0;
+        for(size_t k = 0; k < ns; k++) {
+            meanX += x[k];
+        }
+        meanX /= ns;
+        double varX = 0;
+        for(size_t k = 0; k < ns; k++) {
+            varX += (x[k] - meanX) * (x[k] - meanX);
+        }
+
+        for(size_t link = 0; link < frame.nr * frame.nc; link++) {
+            double* __restrict ph = phase.data() + link * ns;
+            double shift = 0;
+            for(size_t k = 1; k < ns; k++) {
+                double diff = ph[k] + shift - ph[k - 1];
+                shift -= 2 * M_PI * std::round(diff / (2 * M_PI));
+                ph[k] += shift;
+            }
+
+            double meanPh = 0;
+            double cov = 0;
+#pragma omp simd reduction(+:meanPh)
+            for(size_t k = 0; k < ns; k++) {
+                meanPh += ph[k];
+            }
+            meanPh /= ns;
+#pragma omp simd reduction(+:cov)
+            for(size_t k = 0; k < ns; k++) {
+                cov += (x[k] - meanX) * (ph[k] - meanPh);
+            }
+            double slope = varX > 0 ? cov / varX : 0.0;
+            double offset = meanPh - slope * meanX;
+
+            const double* __restrict a = frame.ampl.data() + link * ns;
+            double* __restrict re = frame.re.data() + link * ns;
+            double* __restrict im = frame.im.data() + link * ns;
+            for(size_t k = 0; k < ns; k++) {
+                double p = ph[k] - slope * x[k] - offset;
+                re[k] = a[k] * std::cos(p);
+                im[k] = a[k] * std::sin(p);
+            }
+        }
+    }
+};
+
+//Scales CSI so that its mean power matches the RSSI reported for the frame,
+//either per rx chain or with the combined RSSI
+class RssiNormalizer : public StreamPreprocessor {
+public:
+    Glib::ustring getName() const override {
+        return "Нормализация по RSSI";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        perChain = getDefault(config["rssi_norm"], "per_chain", perChain);
+        reset();
+    }
+
+protected:
+    bool perChain = true;
+
+    void resize(size_t) override {}
+
+    void processFrame(FlatFrame& frame, const FrameInfo& info) override {
+        const size_t perRx = frame.nc * frame.ns;
+        for(size_t r = 0; r < frame.nr; r++) {
+            uint8_t rssi = perChain && r < info.chainRssi.size() && info.chainRssi[r] ? info.chainRssi[r] : info.rssi;
+            if(rssi == 0)
+                continue;
+
+            double* __restrict re = frame.re.data() + r * perRx;
+            double* __restrict im = frame.im.data() + r * perRx;
+            double power = 0;
+#pragma omp simd reduction(+:power)
+            for(size_t i = 0; i < perRx; i++) {
+                power += re[i] * re[i] + im[i] * im[i];
+            }
+            power /= perRx;
+            if(power <= 0)
+                continue;
+
+            double scale = std::sqrt(std::pow(10.0, rssi / 10.0) / power);
+#pragma omp simd
+            for(size_t i = 0; i < perRx; i++) {
+                re[i] *= scale;
+                im[i] *= scale;
+            }
+        }
+    }
+};
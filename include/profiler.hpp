@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+//Scoped-zone profiler. Built only with -DDBC_PROFILER (the Profile target),
+//otherwise PROFILE_ZONE expands to nothing and costs nothing.
+//
+//Every thread writes finished zones into its own fixed size ring buffer,
+//so recording a zone is two clock reads and a store without any locking.
+//dump() collects the buffers of all threads into a Chrome trace JSON
+//that can be opened in chrome://tracing or ui.perfetto.dev.
+//Only the last ringCapacity zones of every thread are kept.
+
+#ifdef DBC_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profilerZone, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) Profiler::getInstance().setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+class Profiler {
+public:
+
+    static constexpr size_t ringCapacity = 1 << 16;   //must be a power of two
+
+    static constexpr bool enabled() {
+#ifdef DBC_PROFILER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static Profiler& getInstance() {
+        static Profiler p;
+        return p;
+    }
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //name must outlive the profiler, string literals are expected
+    class Zone {
+    public:
+        Zone(const char* name) :
+            name(name),
+            start(Profiler::now())
+        {}
+
+        ~Zone() {
+            Profiler::getInstance().threadBuffer().push(name, start, Profiler::now());
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start;
+    };
+
+    void setThreadName(std::string name) {
+        ThreadBuffer& buf = threadBuffer();
+        std::lock_guard lock(buffersMutex);
+        buf.name = std::move(name);
+    }
+
+    //Writes all recorded zones as Chrome trace JSON, returns false if the file can't be written
+    bool dump(const std::string& path) {
+        nlohmann::json events = nlohmann::json::array();
+        const int pid = getpid();
+
+        std::lock_guard lock(buffersMutex);
+        for(const auto& buf : buffers) {
+            events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", pid}, {"tid", buf->tid},
+                              {"args", {{"name", buf->name}}}});
+
+            uint64_t end = buf->written.load(std::memory_order_acquire);
+            uint64_t begin = end > ringCapacity ? end - ringCapacity : 0;
+            std::vector<Event> copy;
+            copy.reserve(end - begin);
+            for(uint64_t i = begin; i < end; i++) {
+                copy.push_back(buf->events[i & (ringCapacity - 1)].load());
+            }
+
+            //The owner thread kept writing while we copied, drop what it overwrote.
+            //Slot endAfter - ringCapacity may be being filled right now, so it's dropped too
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t endAfter = buf->written.load(std::memory_order_relaxed);
+            uint64_t firstValid = endAfter >= ringCapacity ? endAfter - ringCapacity + 1 : 0;
+            for(uint64_t i = std::max(begin, firstValid); i < end; i++) {
+                const Event& ev = copy[i - begin];
+                events.push_back({{"name", ev.name}, {"cat", "zone"}, {"ph", "X"},
+                                  {"ts", ev.start / 1000.0}, {"dur", (ev.end - ev.start) / 1000.0},
+                                  {"pid", pid}, {"tid", buf->tid}});
+            }
+        }
+
+        std::ofstream out(path);
+        if(!out)
+            return false;
+        out << nlohmann::json{{"traceEvents", events}, {"displayTimeUnit", "ns"}}.dump();
+        return static_cast<bool>(out);
+    }
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    //fields are atomics, so dump() can read a slot while its owner rewrites it
+    struct Slot {
+        std::atomic<const char*> name = nullptr;
+        std::atomic<uint64_t> start = 0;
+        std::atomic<uint64_t> end = 0;
+
+        void store(const char* newName, uint64_t newStart, uint64_t newEnd) {
+            name.store(newName, std::memory_order_relaxed);
+            start.store(newStart, std::memory_order_relaxed);
+            end.store(newEnd, std::memory_order_relaxed);
+        }
+
+        Event load() const {
+            return {name.load(std::memory_order_relaxed), start.load(std::memory_order_relaxed), end.load(std::memory_order_relaxed)};
+        }
+    };
+
+    struct ThreadBuffer {
+        std::array<Slot, ringCapacity> events;
+        std::atomic<uint64_t> written = 0;
+        uint32_t tid = 0;
+        std::string name;
+
+        void push(const char* name, uint64_t start, uint64_t end) {
+            uint64_t idx = written.load(std::memory_order_relaxed);
+            events[idx & (ringCapacity - 1)].store(name, start, end);
+            written.store(idx + 1, std::memory_order_release);
+        }
+    };
+
+    std::mutex buffersMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;   //buffers outlive their threads until exit
+    uint32_t nextTid = 1;
+
+    Profiler() = default;
+
+    ThreadBuffer& threadBuffer() {
+        thread_local ThreadBuffer* local = nullptr;
+        if(local == nullptr) {
+            auto buf = std::make_shared<ThreadBuffer>();
+            std::lock_guard lock(buffersMutex);
+            buf->tid = nextTid++;
+            buf->name = "thread " + std::to_string(buf->tid);
+            buffers.push_back(buf);
+            local = buf.get();
+        }
+        return *local;
+    }
+};
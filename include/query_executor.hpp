@@ -0,0 +1,251 @@
+#pragma once
+
+#include "db_handler.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <glibmm/dispatcher.h>
+
+//Runs read queries of the UI on a worker thread with a connection of its own.
+//
+//Every query belongs to a view (the plot, the experiment info, the list...)
+//and a view has at most one query in flight: a query of the view still
+//waiting in the queue is replaced by a new one, a running one is interrupted
+//with sqlite3_interrupt(). Results are delivered in the UI thread through a
+//Dispatcher and only if no newer query of the view was submitted and the
+//view wasn't cancelled meanwhile, so callbacks never see stale data.
+//getInstance() has to be called from the UI thread first.
+//
+//Queries must not touch objects of the UI thread, they get what they need by
+//value (see ExperimentData).
+//
+//post() queues a write job instead: jobs are never replaced or cancelled and
+//run in order ahead of the queries, so a query submitted after a job sees
+//what the job wrote.
+//
+//If the worker can't open its connection it exits and is started again by
+//the next submit() or post(), the queue is kept.
+class QueryExecutor {
+public:
+
+    static QueryExecutor& getInstance() {
+        static QueryExecutor inst;
+        return inst;
+    }
+
+    template<typename R>
+    void submit(const std::string& view, std::function<R(SQLite::Database&)> query, std::function<void(R)> done) {
+        Request request;
+        request.view = view;
+        request.run = [query = std::move(query), done = std::move(done)](SQLite::Database& db) -> std::function<void()> {
+            auto result = std::make_shared<R>(query(db));
+            return [done, result]() { done(std::move(*result)); };
+        };
+
+        {
+            std::lock_guard lock(mutex);
+            request.generation = invalidate(view);
+            auto it = std::find_if(queue.begin(), queue.end(), [&view](const Request& r) { return r.view == view; });
+            if(it != queue.end())
+                *it = std::move(request);
+            else
+                queue.push_back(std::move(request));
+        }
+        ensureWorker();
+        queueChanged.notify_one();
+    }
+
+    void post(std::function<void(SQLite::Database&)> job) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        ensureWorker();
+        queueChanged.notify_one();
+    }
+
+    //drops the query of the view, the callback of a result already on its way isn't called either
+    void cancel(const std::string& view) {
+        std::lock_guard lock(mutex);
+        invalidate(view);
+        std::erase_if(queue, [&view](const Request& r) { return r.view == view; });
+    }
+
+    ~QueryExecutor() {
+        if(worker.joinable()) {
+            worker.request_stop();
+            {
+                std::lock_guard lock(mutex);
+                if(running && workerHandle)
+                    sqlite3_interrupt(workerHandle);
+            }
+            worker.join();
+        }
+    }
+
+private:
+    struct Request {
+        std::string view;
+        uint64_t generation = 0;
+        //runs the query and returns the call of the callback with its result
+        std::function<std::function<void()>(SQLite::Database&)> run;
+    };
+
+    struct Result {
+        std::string view;
+        uint64_t generation = 0;
+        std::function<void()> deliver;
+    };
+
+    std::mutex mutex;
+    std::condition_variable_any queueChanged;
+    std::deque<Request> queue;
+    std::deque<std::function<void(SQLite::Database&)>> jobs;
+    bool workerExited = false;                      //the worker couldn't open its connection
+    std::map<std::string, uint64_t> generations;    //of the latest query of every view
+    std::optional<Request> running;                 //only view and generation are kept
+    sqlite3* workerHandle = nullptr;
+    std::vector<Result> results;
+    std::jthread worker;
+
+    Glib::Dispatcher resultsDispatcher;
+
+    QueryExecutor() {
+        resultsDispatcher.connect([this]() {
+            std::vector<Result> ready;
+            {
+                std::lock_guard lock(mutex);
+                ready.swap(results);
+            }
+            for(Result& result : ready) {
+                {
+                    std::lock_guard lock(mutex);
+                    if(generations[result.view] != result.generation)
+                        continue;
+                }
+                try {
+                    result.deliver();
+                }
+                catch(const std::exception& ex) {
+                    std::cerr << "QueryExecutor: handling result of " << result.view << " failed: " << ex.what() << std::endl;
+                }
+            }
+        });
+    }
+
+    //makes the current query of the view stale and returns the next generation, mutex must be held
+    uint64_t invalidate(const std::string& view) {
+        uint64_t generation = ++generations[view];
+        if(running && running->view == view && workerHandle)
+            sqlite3_interrupt(workerHandle);
+        return generation;
+    }
+
+    //starts the worker, again if it has exited
+    void ensureWorker() {
+        bool exited = false;
+        {
+            std::lock_guard lock(mutex);
+            exited = workerExited;
+            workerExited = false;
+        }
+        if(exited && worker.joinable())
+            worker.join();
+        if(!worker.joinable())
+            worker = std::jthread([this](std::stop_token stoken) { work(stoken); });
+    }
+
+    //runs the jobs waiting at the moment, mutex mustn't be held
+    void runJobs(SQLite::Database& db) {
+        while(true) {
+            std::function<void(SQLite::Database&)> job;
+            {
+                std::lock_guard lock(mutex);
+                if(jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            try {
+                job(db);
+            }
+            catch(const std::exception& ex) {
+                std::cerr << "QueryExecutor: job failed: " << ex.what() << std::endl;
+            }
+        }
+    }
+
+    bool isStale(const Request& request) {
+        std::lock_guard lock(mutex);
+        return generations[request.view] != request.generation;
+    }
+
+    void work(std::stop_token stoken) {
+        std::unique_ptr<SQLite::Database> db;
+        try {
+            db = DB_Handler::open_worker_connection();
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "QueryExecutor: unable to open database: " << ex.what() << std::endl;
+            std::lock_guard lock(mutex);
+            workerExited = true;
+            return;
+        }
+
+        while(!stoken.stop_requested()) {
+            runJobs(*db);
+            Request request;
+            {
+                std::unique_lock lock(mutex);
+                if(!queueChanged.wait(lock, stoken, [this]() { return !queue.empty() || !jobs.empty(); }))
+                    break;
+                if(!jobs.empty())
+                    continue;
+                request = std::move(queue.front());
+                queue.pop_front();
+                running = Request{request.view, request.generation, {}};
+                workerHandle = db->getHandle();
+            }
+
+            std::function<void()> deliver;
+            try {
+                deliver = request.run(*db);
+            }
+            catch(const std::exception& ex) {
+                //an interrupted query is expected to fail
+                if(!isStale(request))
+                    std::cerr << "QueryExecutor: query of " << request.view << " failed: " << ex.what() << std::endl;
+            }
+
+            bool delivered = false;
+            {
+                std::lock_guard lock(mutex);
+                running.reset();
+                if(deliver && generations[request.view] == request.generation) {
+                    results.push_back({request.view, request.generation, std::move(deliver)});
+                    delivered = true;
+                }
+            }
+            if(delivered)
+                resultsDispatcher.emit();
+        }
+
+        runJobs(*db);     //writes mustn't be lost at exit
+        {
+            std::lock_guard lock(mutex);
+            workerHandle = nullptr;
+        }
+        DB_Handler::forget_connection(*db);
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include <SQLiteCpp/SQLiteCpp.h>
+#include "handler_base.hpp"
+#include "sql_qualify.hpp"
+
+//Precomputed per-stream aggregates of amplitude and phase, used to draw
+//long experiments without reading every measurement.
+//
+//measurement_rollup keeps count/min/max/sum for every (rx, tx, subcarrier)
+//in time buckets of 1, 16, 256 and 4096 seconds (levels 0..3, bucket is
+//timestamp / scale). A query for N buckets reads the coarsest level that
+//is still finer than the requested bucket, so it touches at most
+//factor * N rows whatever the length of the experiment.
+//
+//RollupAccumulator collects frames of the current bucket of every level in
+//memory and upserts them when the bucket changes or on flush(), so a bucket
+//may be written several times and is merged by the upsert.
+namespace Rollups {
+
+constexpr size_t levels = 4;
+constexpr unsigned factorBits = 4;      //every level is 16 times coarser
+
+inline int64_t levelScale(size_t level) {
+    return int64_t(1) << (factorBits * level);
+}
+
+//coarsest level whose buckets aren't wider than width seconds
+inline size_t levelForWidth(int64_t width) {
+    size_t level = 0;
+    while(level + 1 < levels && levelScale(level + 1) <= width)
+        level++;
+    return level;
+}
+
+//measurement_rollup of the experiment is referenced as data.measurement_rollup,
+//see qualifySql
+inline const char* upsertSql() {
+    return R"asd(
+        INSERT INTO data.measurement_rollup (experiment_id, rx, tx, num_sub, level, bucket, count,
+                                        ampl_min, ampl_max, ampl_sum, phase_min, phase_max, phase_sum)
+        VALUES (@exp_id, @rx, @tx, @num_sub, @level, @bucket, @count,
+                @ampl_min, @ampl_max, @ampl_sum, @phase_min, @phase_max, @phase_sum)
+        ON CONFLICT (experiment_id, rx, tx, num_sub, level, bucket) DO UPDATE SET
+            count = count + excluded.count,
+            ampl_min = MIN(ampl_min, excluded.ampl_min),
+            ampl_max = MAX(ampl_max, excluded.ampl_max),
+            ampl_sum = ampl_sum + excluded.ampl_sum,
+            phase_min = MIN(phase_min, excluded.phase_min),
+            phase_max = MAX(phase_max, excluded.phase_max),
+            phase_sum = phase_sum + excluded.phase_sum
+    )asd";
+}
+
+//Recomputes all rollups of an experiment from stored measurements,
+//for data that didn't pass through RollupAccumulator (migration, import)
+inline void rebuild(SQLite::Database& db, int32_t expId, const std::string& schema = "main") {
+    SQLite::Statement clear(db, qualifySql("DELETE FROM data.measurement_rollup WHERE experiment_id = @exp_id", schema));
+    clear.bind("@exp_id", expId);
+    clear.exec();
+
+    SQLite::Statement fill(db, qualifySql(R"asd(
+        INSERT INTO data.measurement_rollup (experiment_id, rx, tx, num_sub, level, bucket, count,
+                                        ampl_min, ampl_max, ampl_sum, phase_min, phase_max, phase_sum)
+        SELECT packet.experiment_id, measurement.rx, measurement.tx, measurement.num_sub, @level,
+               packet.timestamp / @scale AS bucket, COUNT(1),
+               MIN(amplitude), MAX(amplitude), SUM(amplitude), MIN(phase), MAX(phase), SUM(phase)
+        FROM data.processed_measurement
+        INNER JOIN data.measurement ON processed_measurement.id_measurement = measurement.id
+        INNER JOIN data.packet ON measurement.id_packet = packet.id
+        WHERE packet.experiment_id = @exp_id AND packet.timestamp IS NOT NULL
+        GROUP BY measurement.rx, measurement.tx, measurement.num_sub, bucket
+    )asd", schema));
+    for(size_t level = 0; level < levels; level++) {
+        fill.bind("@exp_id", expId);
+        fill.bind("@level", static_cast<int32_t>(level));
+        fill.bind("@scale", levelScale(level));
+        fill.exec();
+        fill.reset();
+    }
+}
+
+}
+
+class RollupAccumulator {
+public:
+
+    void add(SQLite::Database& db, int32_t expId, const std::string& schema, const HandlerBase::datatype& data, int64_t timestamp) {
+        const size_t nr = data.first.size();
+        const size_t nc = nr ? data.first[0].size() : 0;
+        const size_t ns = nc ? data.first[0][0].size() : 0;
+        if(nr != rxCount || nc != txCount || ns != subCount) {
+            flush(db, expId, schema);
+            rxCount = nr;
+            txCount = nc;
+            subCount = ns;
+        }
+
+        for(size_t level = 0; level < Rollups::levels; level++) {
+            int64_t bucket = timestamp / Rollups::levelScale(level);
+            if(bucket != buckets[level].bucket) {
+                flushLevel(db, expId, schema, level);
+                buckets[level].bucket = bucket;
+            }
+            buckets[level].stats.resize(nr * nc * ns);
+        }
+
+        size_t s = 0;
+        for(size_t rx = 0; rx < nr; rx++) {
+            for(size_t tx = 0; tx < nc; tx++) {
+                for(size_t sub = 0; sub < ns; sub++, s++) {
+                    double re = data.first[rx][tx][sub];
+                    double im = data.second[rx][tx][sub];
+                    double ampl = std::sqrt(re * re + im * im);
+                    double phase = std::atan2(im, re);
+                    for(Level& lvl : buckets) {
+                        lvl.stats[s].add(ampl, phase);
+                    }
+                }
+            }
+        }
+    }
+
+    //moves what's accumulated so far into the returned accumulator, its flush()
+    //may run on another connection, the upsert merges both parts of a bucket
+    RollupAccumulator take() {
+        RollupAccumulator taken = *this;
+        for(Level& lvl : buckets)
+            lvl.stats.clear();
+        return taken;
+    }
+
+    //writes everything accumulated so far, safe to call inside or outside of a transaction
+    void flush(SQLite::Database& db, int32_t expId, const std::string& schema) {
+        for(size_t level = 0; level < Rollups::levels; level++) {
+            flushLevel(db, expId, schema, level);
+        }
+    }
+
+private:
+    struct Stats {
+        uint32_t count = 0;
+        double amplMin = std::numeric_limits<double>::max();
+        double amplMax = std::numeric_limits<double>::lowest();
+        double amplSum = 0;
+        double phaseMin = std::numeric_limits<double>::max();
+        double phaseMax = std::numeric_limits<double>::lowest();
+        double phaseSum = 0;
+
+        void add(double ampl, double phase) {
+            count++;
+            amplMin = std::min(amplMin, ampl);
+            amplMax = std::max(amplMax, ampl);
+            amplSum += ampl;
+            phaseMin = std::min(phaseMin, phase);
+            phaseMax = std::max(phaseMax, phase);
+            phaseSum += phase;
+        }
+    };
+
+    struct Level {
+        int64_t bucket = -1;
+        std::vector<Stats> stats;   //rx-major, then tx, then subcarrier
+    };
+
+    std::array<Level, Rollups::levels> buckets;
+    size_t rxCount = 0;
+    size_t txCount = 0;
+    size_t subCount = 0;
+
+    void flushLevel(SQLite::Database& db, int32_t expId, const std::string& schema, size_t level) {
+        Level& lvl = buckets[level];
+        if(lvl.stats.empty() || lvl.bucket < 0)
+            return;
+
+        db.exec("SAVEPOINT rollup_flush");
+        try {
+            SQLite::Statement upsert(db, qualifySql(Rollups::upsertSql(), schema));
+            size_t s = 0;
+            for(size_t rx = 0; rx < rxCount; rx++) {
+                for(size_t tx = 0; tx < txCount; tx++) {
+                    for(size_t sub = 0; sub < subCount; sub++, s++) {
+                        const Stats& st = lvl.stats[s];
+                        if(st.count == 0)
+                            continue;
+                        upsert.bind("@exp_id", expId);
+                        upsert.bind("@rx", static_cast<uint32_t>(rx));
+                        upsert.bind("@tx", static_cast<uint32_t>(tx));
+                        upsert.bind("@num_sub", static_cast<uint32_t>(sub));
+                        upsert.bind("@level", static_cast<uint32_t>(level));
+                        upsert.bind("@bucket", lvl.bucket);
+                        upsert.bind("@count", st.count);
+                        upsert.bind("@ampl_min", st.amplMin);
+                        upsert.bind("@ampl_max", st.amplMax);
+                        upsert.bind("@ampl_sum", st.amplSum);
+                        upsert.bind("@phase_min", st.phaseMin);
+                        upsert.bind("@phase_max", st.phaseMax);
+                        upsert.bind("@phase_sum", st.phaseSum);
+                        upsert.exec();
+                        upsert.reset();
+                    }
+                }
+            }
+            db.exec("RELEASE rollup_flush");
+        }
+        catch(...) {
+            db.exec("ROLLBACK TO rollup_flush");
+            db.exec("RELEASE rollup_flush");
+            lvl.stats.clear();
+            throw;
+        }
+        lvl.stats.clear();
+    }
+};
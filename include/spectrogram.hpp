@@ -0,0 +1,153 @@
+#pragma once
+
+#include "preprocessors.hpp"
+#include "fft.hpp"
+
+//Short-time FFT of the amplitude of every (rx, tx, subcarrier) stream.
+//
+//Keeps the last window amplitudes of all streams, and every hop frames
+//transforms all of them in one batch (mean removed, Hann window).
+//The emitted frame has the same rx/tx layout as the input, its last axis
+//holds the spectra of the subcarriers one after another, bins 0..window/2
+//each (subcarrier * (window/2 + 1) + bin), or only the spectrum of the
+//selected subcarrier. first and second are the real and imaginary parts
+//of the bins, so the stored amplitude and phase are those of the spectrum.
+//Frames between hops are skipped.
+//
+//Settings: "doppler": {"window": 64, "hop": 16, "subcarrier": -1}
+class DopplerSpectrogram : public PreprocessingHandler {
+public:
+    Glib::ustring getName() const override {
+        return "Допплеровская спектрограмма";
+    }
+
+    void set_settings(nlohmann::json config) override {
+        size_t newWindow = std::clamp<size_t>(getDefault(config["doppler"], "window", window), 8, 4096);
+        while(!BatchFft::isPowerOfTwo(newWindow))
+            newWindow &= newWindow - 1;     //round down to a power of two
+        window = newWindow;
+        hop = std::clamp<size_t>(getDefault(config["doppler"], "hop", hop), 1, window);
+        subcarrier = getDefault(config["doppler"], "subcarrier", subcarrier);
+        reset();
+    }
+
+    void reset() override {
+        streams = 0;
+    }
+
+    std::optional<HandlerBase::datatype> process(const HandlerBase::datatype& toProcess, const FrameInfo& = FrameInfo()) override {
+        if(!frame.load(toProcess) || frame.streams() == 0)
+            return std::nullopt;
+        if(frame.streams() != streams || frame.ns != subcarriers)
+            resize();
+
+        const size_t n = streams;
+        frame.computeAmplitude();
+        std::copy(frame.ampl.begin(), frame.ampl.end(), history.begin() + pos * n);
+        pos = (pos + 1) % window;
+        filled = std::min(filled + 1, window);
+        sinceLast++;
+        if(filled < window || sinceLast < hop)
+            return std::nullopt;
+        sinceLast = 0;
+
+        transform();
+        return collectBins();
+    }
+
+private:
+    size_t window = 64;
+    size_t hop = 16;
+    int subcarrier = -1;            //-1 emits the spectra of all subcarriers
+
+    FlatFrame frame;
+    size_t streams = 0;
+    size_t subcarriers = 0;
+    size_t pos = 0;
+    size_t filled = 0;
+    size_t sinceLast = 0;
+
+    BatchFft fft;
+    std::vector<double> hann;
+    std::vector<double> history;    //window x streams, ring by pos
+    std::vector<double> re;         //window x streams, time order
+    std::vector<double> im;
+    std::vector<double> mean;
+
+    void resize() {
+        streams = frame.streams();
+        subcarriers = frame.ns;
+        fft.setSize(window);
+        hann.resize(window);
+        for(size_t i = 0; i < window; i++) {
+            hann[i] = 0.5 - 0.5 * std::cos(2 * M_PI * i / window);
+        }
+        history.assign(window * streams, 0.0);
+        re.resize(window * streams);
+        im.resize(window * streams);
+        mean.resize(streams);
+        pos = 0;
+        filled = 0;
+        sinceLast = 0;
+    }
+
+    void transform() {
+        const size_t n = streams;
+        double* __restrict m = mean.data();
+        std::fill(mean.begin(), mean.end(), 0.0);
+        for(size_t t = 0; t < window; t++) {
+            const double* __restrict h = history.data() + t * n;
+#pragma omp simd
+            for(size_t i = 0; i < n; i++) {
+                m[i] += h[i];
+            }
+        }
+        const double norm = 1.0 / window;
+#pragma omp simd
+        for(size_t i = 0; i < n; i++) {
+            m[i] *= norm;
+        }
+
+        //oldest sample is at pos
+        for(size_t t = 0; t < window; t++) {
+            const double* __restrict h = history.data() + ((pos + t) % window) * n;
+            double* __restrict r = re.data() + t * n;
+            const double w = hann[t];
+#pragma omp simd
+            for(size_t i = 0; i < n; i++) {
+                r[i] = (h[i] - m[i]) * w;
+            }
+        }
+        std::fill(im.begin(), im.end(), 0.0);
+        fft.forward(re.data(), im.data(), n);
+    }
+
+    HandlerBase::datatype collectBins() const {
+        const size_t bins = window / 2 + 1;
+        const size_t ns = subcarriers;
+        const bool single = subcarrier >= 0 && static_cast<size_t>(subcarrier) < ns;
+        const size_t first = single ? subcarrier : 0;
+        const size_t count = single ? 1 : ns;
+
+        HandlerBase::datatype result;
+        result.first.assign(frame.nr, std::vector<std::vector<double>>(frame.nc, std::vector<double>(count * bins)));
+        result.second = result.first;
+        for(size_t r = 0; r < frame.nr; r++) {
+            for(size_t c = 0; c < frame.nc; c++) {
+                const size_t base = (r * frame.nc + c) * ns + first;
+                double* __restrict outRe = result.first[r][c].data();
+                double* __restrict outIm = result.second[r][c].data();
+                //bins of a signal are strided by streams, the output is signal-major
+                for(size_t b = 0; b < bins; b++) {
+                    const double* __restrict br = re.data() + b * streams + base;
+                    const double* __restrict bi = im.data() + b * streams + base;
+                    for(size_t k = 0; k < count; k++) {
+                        outRe[k * bins + b] = br[k];
+                        outIm[k * bins + b] = bi[k];
+                    }
+                }
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cctype>
+#include <string>
+#include <string_view>
+
+//Tables holding packets and measurements live either in the main database or
+//in an attached experiment shard. Queries on them name the tables as
+//data.packet, data.measurement... and this replaces the "data." placeholder
+//with the real schema name ("main" or "shard_<id>").
+//
+//Only "data." starting a word and followed by a shard table is replaced, so
+//string literals and names like metadata.x or data.packet_count stay as they are.
+inline std::string qualifySql(const std::string& sql, const std::string& schema) {
+    static constexpr std::array<std::string_view, 8> shardTables = {
+        "packet", "measurement", "processed_measurement", "measurement_rollup",
+        "marker", "marker_segment", "time_base", "tsf_base"
+    };
+    const std::string_view placeholder = "data.";
+    auto isWordChar = [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    };
+
+    std::string result;
+    result.reserve(sql.size() + 16);
+    char quote = 0;
+    for(size_t pos = 0; pos < sql.size();) {
+        const char c = sql[pos];
+        if(quote) {
+            if(c == quote)
+                quote = 0;
+            result += c;
+            ++pos;
+            continue;
+        }
+        if(c == '\'' || c == '"') {
+            quote = c;
+            result += c;
+            ++pos;
+            continue;
+        }
+
+        if(sql.compare(pos, placeholder.size(), placeholder) == 0 && (pos == 0 || !isWordChar(sql[pos - 1]))) {
+            const size_t nameStart = pos + placeholder.size();
+            size_t nameEnd = nameStart;
+            while(nameEnd < sql.size() && isWordChar(sql[nameEnd]))
+                ++nameEnd;
+            const std::string_view name(sql.data() + nameStart, nameEnd - nameStart);
+            bool known = false;
+            for(std::string_view table : shardTables)
+                known = known || name == table;
+            if(known) {
+                result += schema;
+                result += '.';
+                result += name;
+                pos = nameEnd;
+                continue;
+            }
+        }
+        result += c;
+        ++pos;
+    }
+    return result;
+}
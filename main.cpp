@@ -4,8 +4,21 @@
 #include <array>
 
 #include "experiments_list.hpp"
+#include "experiments_list_model.hpp"
+#include "capture_pipeline.hpp"
 #include "hw_list.hpp"
 #include "ExtendablePlot.hpp"
+#include "metrics_exporter.hpp"
+#include "profiler.hpp"
+#include <csignal>
+#include <ctime>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <mutex>
+#include <thread>
 
 namespace
 {
@@ -20,7 +33,63 @@ std::shared_ptr<DataSet> dataToDraw;
 ReceiverHandler* curRecvHandler = nullptr;
 PreprocessingHandler* curPreprocessor = nullptr;
 
-cv::VideoCapture camera;
+std::unique_ptr<cv::VideoCapture> camera;     //set once the background probe finds one
+
+MetricsExporter metricsExporter;
+
+//Logs how long the startup stages take, stages of background tasks included
+class StartupLog {
+public:
+    using clock = std::chrono::steady_clock;
+
+    void stage(std::string_view name, clock::time_point from) {
+        auto now = clock::now();
+        std::lock_guard lock(mutex);
+        std::cout << "Startup: " << name << " " << toMs(now - from) << " ms (at " << toMs(now - start) << " ms)" << std::endl;
+    }
+
+private:
+    const clock::time_point start = clock::now();   //about the start of the process
+    std::mutex mutex;
+
+    static long long toMs(clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    }
+} startupLog;
+
+//Runs work on a thread of its own and then done in the UI thread, has to be created in the UI thread
+class BackgroundTask {
+public:
+    BackgroundTask(std::function<void()> work, std::function<void()> done) {
+        dispatcher.connect(std::move(done));
+        thread = std::jthread([this, work = std::move(work)]() {
+            try {
+                work();
+            }
+            catch(const std::exception& ex) {
+                std::cerr << "Background task failed: " << ex.what() << std::endl;
+            }
+            dispatcher.emit();
+        });
+    }
+
+private:
+    Glib::Dispatcher dispatcher;
+    std::jthread thread;
+};
+
+std::unique_ptr<BackgroundTask> cameraProbe;
+std::unique_ptr<BackgroundTask> catalogLoad;
+
+volatile std::sig_atomic_t traceDumpRequested = 0;
+
+//values of the plot selection widgets, kept here so pipelineWorker doesn't look widgets up for every frame
+struct PlotSelection {
+    uint32_t subcar = 0;
+    uint32_t rx = 0;
+    uint32_t tx = 0;
+    bool ampl = true;
+} plotSelection;
 
 template<typename T>
 auto getWidget(std::string_view name) {
@@ -51,8 +120,22 @@ void update_extra_info() {
         if(exp.getPreprocessor())
             setEntryText("extra_info_preproc_entry", exp.getPreprocessor()->get().getName());
 
-        setEntryText("extra_info_entries_count_entry", std::to_string(exp.getPacketsCount()));
-        setEntryText("extra_info_photos_count_entry", std::to_string(exp.getPhotosCount()));
+        ExperimentData data = exp.data();
+        QueryExecutor::getInstance().submit<ExperimentStats::Stats>("extra_info",
+            [data](SQLite::Database& db) { return data.getStats(db); },
+            [setEntryText](ExperimentStats::Stats stats) {
+                setEntryText("extra_info_entries_count_entry", std::to_string(stats.packets));
+                setEntryText("extra_info_photos_count_entry", std::to_string(stats.photos));
+                setEntryText("extra_info_dims_entry", std::to_string(stats.rx) + " x " + std::to_string(stats.tx) + " x " + std::to_string(stats.subcarriers));
+                setEntryText("extra_info_size_entry", std::to_string(stats.bytesUsed / (1024 * 1024)) + " МБ");
+
+                auto formatTime = [](std::optional<int64_t> time) -> std::string {
+                    if(!time)
+                        return "-";
+                    return Glib::DateTime::create_now_local(*time).format("%Y-%m-%d %H:%M:%S");
+                };
+                setEntryText("extra_info_period_entry", formatTime(stats.firstTimestamp) + " - " + formatTime(stats.lastTimestamp));
+            });
     }
     catch(const std::out_of_range& ex) {
         std::cerr << "Something went wrong and selected experiment is out of range of available experiments" << std::endl;
@@ -75,43 +158,45 @@ auto getObject(std::string_view name) {
 }
 
 bool pipelineWorker() {
-    HandlerBase::datatype data;
-
     if (curRecvHandler == nullptr)
         return true;
-    auto mbData = curRecvHandler->tryCollect();
-    if(mbData)
-        data = std::move(*mbData);
-
-    if(curPreprocessor != nullptr) {
-        auto mbProcessedData = curPreprocessor->process(data);
-        if(mbProcessedData)
-            data = std::move(*mbProcessedData);
-    }
+    auto frame = CapturePipeline::collect(*curRecvHandler, curPreprocessor);
+    if(!frame)
+        return true;
+    PROFILE_ZONE("pipelineWorker");
 
     if(main_window_selected_exp == GTK_INVALID_LIST_POSITION)
         return true;
 
     try {
         Experiment& exp = ExperimentsList::getInstance().getExperimentByIdx(main_window_selected_exp);
-        exp.addPoint(data);
+        CapturePipeline::store(exp, *frame);
 
-        uint32_t subcar = getWidget<Gtk::SpinButton>("main_window_subcar_sb")->get_value_as_int();
-        uint32_t rx = getWidget<Gtk::SpinButton>("main_window_recv_ant_sb")->get_value_as_int();
-        uint32_t tx = getWidget<Gtk::SpinButton>("main_window_trans_ant_sb")->get_value_as_int();
-        bool selectedAmpl = getWidget<Gtk::DropDown>("main_window_drawed_data_type")->get_selected() == 0;
+        const HandlerBase::datatype& data = frame->data;
+        const uint32_t subcar = plotSelection.subcar;
+        const uint32_t rx = plotSelection.rx;
+        const uint32_t tx = plotSelection.tx;
 
-        auto& selectedPart = selectedAmpl ? data.first : data.second;
-        if(rx < selectedPart.size() && tx < selectedPart[rx].size() && subcar < selectedPart[rx][tx].size()) {
-            int real = data.first[rx][tx][subcar];
-            int imag = data.second[rx][tx][subcar];
-
-            double val;
-            if(selectedAmpl)
-                val = std::sqrt(real * real + imag * imag);
-            else
-                val = std::atan2(imag, real);
-            dataToDraw->addDataPoint(val);
+        auto hasStream = [rx, tx, subcar](const auto& part) {
+            return rx < part.size() && tx < part[rx].size() && subcar < part[rx][tx].size();
+        };
+        if(hasStream(data.first) && hasStream(data.second)) {
+            PROFILE_ZONE("plot update");
+            Metrics::ScopedTimer timer(Metrics::Stage::PlotUpdate);
+            const double re = data.first[rx][tx][subcar];
+            const double im = data.second[rx][tx][subcar];
+            if(exp.storesRawCsi()) {
+                //integer CSI, amplitude or phase is computed by the plot
+                auto toInt16 = [](double val) {
+                    return static_cast<int16_t>(std::clamp<double>(val, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max()));
+                };
+                dataToDraw->addRawPoint(toInt16(re), toInt16(im));
+            }
+            else {
+                //preprocessed values, the same amplitude or phase as processed_measurement
+                const double value = plotSelection.ampl ? std::sqrt(re * re + im * im) : std::atan2(im, re);
+                dataToDraw->addDataWithoutX(&value, &value + 1);
+            }
         }
     }
     catch(const std::out_of_range& ex) {
@@ -123,6 +208,7 @@ bool pipelineWorker() {
     catch(...) {
         std::cerr << "Unknown exception during pipeline working" << std::endl;
     }
+    curRecvHandler->recycle(std::move(frame->data));
 
     return true;
 }
@@ -131,14 +217,20 @@ bool camera_worker() {
     if(!getWidget<Gtk::ToggleButton>("main_window_start_recv")->get_active())
         return true;
 
+    if(!camera)
+        return true;
+
     cv::Mat frame;
-    camera >> frame;
+    *camera >> frame;
     if(main_window_selected_exp == GTK_INVALID_LIST_POSITION)
         return true;
 
     try {
         Experiment& exp = ExperimentsList::getInstance().getExperimentByIdx(main_window_selected_exp);
+        PROFILE_ZONE("addPhoto");
+        Metrics::ScopedTimer timer(Metrics::Stage::AddPhoto);
         exp.addPhoto(frame);
+        Metrics::getInstance().add(Metrics::Counter::Photos);
     }
     catch(const std::out_of_range& ex) {
         std::cerr << "Something went wrong and selected experiment is out of range of available experiments" << std::endl;
@@ -224,6 +316,7 @@ void experiment_window_process() {
 void stopDataCollecting() {
     getWidget<Gtk::ToggleButton>("main_window_start_recv")->set_active(false);
     HandlersList::getInstance().pauseAll();
+    ExperimentsList::getInstance().flushRollups();
 }
 
 void updateMainWindow() {
@@ -263,7 +356,7 @@ void updateMainWindow() {
         }
     }
 
-    ExperimentsList::getInstance().updateList(filter);
+    ExperimentsList::getInstance().updateListAsync(filter);
 }
 
 void import_window_process() {
@@ -305,6 +398,7 @@ void import_window_process() {
 
     auto final_button = getWidget<Gtk::Button>("import_window_import_button");
     final_button->signal_clicked().connect([](){
+        PROFILE_ZONE("import");
         try {
             continue_import = true;
             HW_List& hw_list = HW_List::get_instance();
@@ -365,6 +459,7 @@ void import_window_process() {
             auto pbar = getWidget<Gtk::LevelBar>("import_progress_bar");
 
             while(packetsSelect.executeStep()) {
+                PROFILE_ZONE("import packet");
                 packets_pasted++;
                 pbar->set_value(static_cast<double>(packets_pasted) / static_cast<double>(packets_n));
                 uint32_t old_pack_idx = packetsSelect.getColumn(0);
@@ -411,6 +506,10 @@ void import_window_process() {
                 Glib::MainContext::get_default()->iteration(false);
             }
 
+            MarkerSegments::rebuild(db, expId);
+            PacketTime::backfill(db, expId);
+            Rollups::rebuild(db, expId);
+            ExperimentStats::rebuild(db, expId);
             commit.commit();
             updateMainWindow();
         }
@@ -516,6 +615,18 @@ void hardware_window_process()
     update_list();
 }
 
+constexpr uint32_t plotBucketsThreshold = 20000;    //packets, above it updatePlot draws buckets
+constexpr size_t plotBuckets = 2000;
+constexpr size_t plotWindowPoints = 100000;         //points kept by the plot, a whole history load fits
+
+//what updatePlot draws, read by QueryExecutor
+struct PlotPoints {
+    bool bucketed = false;
+    std::vector<std::pair<double, double>> envelope;    //bucketed
+    std::vector<ExperimentData::RawPoint> raw;          //one per packet otherwise, integer CSI
+    std::vector<double> values;                         //one per packet otherwise, preprocessed
+};
+
 void updatePlot() {
     if(main_window_selected_exp == GTK_INVALID_LIST_POSITION)
         return;
@@ -524,14 +635,50 @@ void updatePlot() {
     try {
         Experiment& exp = ExperimentsList::getInstance().getExperimentByIdx(pos);
 
-        uint32_t subcar = getWidget<Gtk::SpinButton>("main_window_subcar_sb")->get_value_as_int();
-        uint32_t rx = getWidget<Gtk::SpinButton>("main_window_recv_ant_sb")->get_value_as_int();
-        uint32_t tx = getWidget<Gtk::SpinButton>("main_window_trans_ant_sb")->get_value_as_int();
-        bool selectedAmpl = getWidget<Gtk::DropDown>("main_window_drawed_data_type")->get_selected() == 0;
-
-        std::vector<double> points = exp.getPoints(rx, tx, subcar, selectedAmpl);
-        dataToDraw->clear();
-        dataToDraw->addDataWithoutX(points.begin(), points.end());
+        const uint32_t subcar = plotSelection.subcar;
+        const uint32_t rx = plotSelection.rx;
+        const uint32_t tx = plotSelection.tx;
+        const bool selectedAmpl = plotSelection.ampl;
+
+        //long experiments are drawn as a min/max envelope of time buckets,
+        //x stays the packet index so live points continue the plot
+        ExperimentData data = exp.data();
+        //the worker reads only what's written, the job runs ahead of the query
+        QueryExecutor::getInstance().post([data, pending = exp.takeRollups()](SQLite::Database& db) mutable {
+            pending.flush(db, data.id, data.schema(db));
+        });
+        auto query = [data, subcar, rx, tx, selectedAmpl](SQLite::Database& db) {
+            PlotPoints result;
+            auto range = data.getTimeRange(db);
+            if(data.getStats(db).packets > plotBucketsThreshold && range) {
+                auto buckets = data.getPointsBucketed(db, rx, tx, subcar, selectedAmpl, range->first, range->second, plotBuckets);
+                result.bucketed = true;
+                result.envelope.reserve(buckets.size() * 2);
+                double x = 0;
+                for(const auto& b : buckets) {
+                    result.envelope.emplace_back(x, b.min);
+                    result.envelope.emplace_back(x + b.count - 1, b.max);
+                    x += b.count;
+                }
+            }
+            else if(data.rawCsi) {
+                result.raw = data.getRawPoints(db, rx, tx, subcar);
+            }
+            else {
+                result.values = data.getPoints(db, rx, tx, subcar, selectedAmpl);
+            }
+            return result;
+        };
+        //live points drawn before the result comes are replaced by it
+        QueryExecutor::getInstance().submit<PlotPoints>("plot", query, [](PlotPoints points) {
+            dataToDraw->clear();
+            if(points.bucketed)
+                dataToDraw->addData(points.envelope.begin(), points.envelope.end());
+            else if(!points.raw.empty())
+                dataToDraw->addRawData(points.raw.begin(), points.raw.end());
+            else
+                dataToDraw->addDataWithoutX(points.values.begin(), points.values.end());
+        });
     }
     catch(const std::out_of_range& ex) {
         std::cerr << "Something went wrong and selected experiment is out of range of available experiments" << std::endl;
@@ -544,6 +691,66 @@ void updatePlot() {
     }
 }
 
+//results of queries for the previously selected experiment are of no use anymore
+void cancelExperimentQueries() {
+    QueryExecutor::getInstance().cancel("plot");
+    QueryExecutor::getInstance().cancel("extra_info");
+    ExperimentsList::getInstance().cancelExperimentRequest();
+}
+
+void readPlotSelection() {
+    plotSelection.subcar = getWidget<Gtk::SpinButton>("main_window_subcar_sb")->get_value_as_int();
+    plotSelection.rx = getWidget<Gtk::SpinButton>("main_window_recv_ant_sb")->get_value_as_int();
+    plotSelection.tx = getWidget<Gtk::SpinButton>("main_window_trans_ant_sb")->get_value_as_int();
+    plotSelection.ampl = getWidget<Gtk::DropDown>("main_window_drawed_data_type")->get_selected() == 0;
+    dataToDraw->setRawView(plotSelection.ampl ? DataSet::RawView::Amplitude : DataSet::RawView::Phase);
+}
+
+void onPlotSelectionChanged() {
+    PlotSelection previous = plotSelection;
+    readPlotSelection();
+    //raw points of the stream are already drawn, the plot switches between amplitude and phase itself;
+    //preprocessed series aren't raw and are read again
+    if(dataToDraw->isRaw() && previous.subcar == plotSelection.subcar && previous.rx == plotSelection.rx && previous.tx == plotSelection.tx)
+        return;
+    updatePlot();
+}
+
+//fills the main window with the experiment activated in the list
+void showSelectedExperiment(Experiment& exp) {
+    try {
+        auto setEntryText = [](std::string_view entryName, Glib::ustring text) {
+            getWidget<Gtk::Entry>(entryName.data())->get_buffer()->set_text(text);
+        };
+
+        setEntryText("main_exp_name_entry", exp.getName());
+        getObject<Gtk::TextBuffer>("main_exp_desc_buffer")->set_text(exp.getDescription());
+        getObject<Gtk::TextBuffer>("main_window_json_buf")->set_text(exp.getConfig().dump(4));
+        stopDataCollecting();
+
+        if(exp.getReceiverHandler())
+            curRecvHandler = &(exp.getReceiverHandler()->get());
+        else
+            curRecvHandler = nullptr;
+
+        if(exp.getPreprocessor()) {
+            curPreprocessor = &(exp.getPreprocessor()->get());
+            curPreprocessor->set_settings(exp.getConfig());    //also drops state of the previous experiment
+        }
+        else
+            curPreprocessor = nullptr;
+
+        updatePlot();
+        update_extra_info();
+    }
+    catch(const std::exception& ex) {
+        std::cerr << "Exception during updating info about new selected experiment: " << ex.what() << std::endl;
+    }
+    catch(...) {
+        std::cerr << "Unknown exception during updating info about new selected experiment" << std::endl;
+    }
+}
+
 void export_window_process() {
     auto path_button = getWidget<Gtk::Button>("export_select_dir_button");
     path_button->signal_clicked().connect([](){
@@ -604,6 +811,69 @@ void export_window_process() {
 
 }
 
+void stats_window_process() {
+    static Metrics::Snapshot previous = Metrics::getInstance().snapshot();
+
+    Glib::signal_timeout().connect([]() {
+        if(!getWidget<Gtk::Window>("stats_window")->get_visible())
+            return true;
+
+        Metrics::Snapshot snap = Metrics::getInstance().snapshot(&previous);
+        previous = snap;
+        getObject<Gtk::TextBuffer>("stats_text_buffer")->set_text(snap.toText());
+        return true;
+    }, 1000);
+
+    if(auto settings = MetricsExporter::settingsFromEnv())
+        metricsExporter.start(*settings);
+
+    auto dumpTrace = []() {
+        std::string path = "trace_" + std::to_string(std::time(nullptr)) + ".json";
+        if(Profiler::getInstance().dump(path))
+            std::cerr << "Trace is written into " << path << std::endl;
+        else
+            std::cerr << "Unable to write trace into " << path << std::endl;
+    };
+
+    auto dump_bn = getWidget<Gtk::Button>("stats_dump_trace_bn");
+    dump_bn->set_sensitive(Profiler::enabled());
+    dump_bn->signal_clicked().connect(dumpTrace);
+
+    //kill -USR1 <pid> dumps a trace from a running instance
+    std::signal(SIGUSR1, [](int) { traceDumpRequested = 1; });
+    Glib::signal_timeout().connect([dumpTrace]() {
+        if(traceDumpRequested) {
+            traceDumpRequested = 0;
+            dumpTrace();
+        }
+        return true;
+    }, 500);
+}
+
+void deletion_process() {
+    ExperimentDeleter& deleter = ExperimentDeleter::getInstance();
+    auto progressBar = getWidget<Gtk::ProgressBar>("main_window_delete_progress");
+    deleter.signalProgress().connect([progressBar](double fraction, size_t waiting) {
+        progressBar->set_visible(true);
+        progressBar->set_fraction(fraction);
+        if(waiting > 0)
+            progressBar->set_text("Удаление... (ещё " + std::to_string(waiting) + ")");
+        else
+            progressBar->set_text("Удаление...");
+    });
+    deleter.signalDeleted().connect([progressBar](int32_t) {
+        if(!ExperimentDeleter::getInstance().isBusy())
+            progressBar->set_visible(false);
+    });
+
+    try {
+        deleter.resumePending();
+    }
+    catch(const std::exception& ex) {
+        std::cerr << "Failed to resume deleting experiments: " << ex.what() << std::endl;
+    }
+}
+
 void main_window_process(Glib::RefPtr<Gtk::Builder> pBuilder)
 {
 
@@ -631,48 +901,26 @@ void main_window_process(Glib::RefPtr<Gtk::Builder> pBuilder)
     auto exp_list_view = getWidget<Gtk::ListView>("experiments_list_view");
     exp_list_view->signal_activate().connect([](size_t pos) {
         main_window_selected_exp = pos;
+        cancelExperimentQueries();
 
         if(pos == GTK_INVALID_LIST_POSITION)
             return;
 
-        try {
-            Experiment& exp = ExperimentsList::getInstance().getExperimentByIdx(pos);
-            auto setEntryText = [](std::string_view entryName, Glib::ustring text) {
-                getWidget<Gtk::Entry>(entryName.data())->get_buffer()->set_text(text);
-            };
-
-            setEntryText("main_exp_name_entry", exp.getName());
-            getObject<Gtk::TextBuffer>("main_exp_desc_buffer")->set_text(exp.getDescription());
-            getObject<Gtk::TextBuffer>("main_window_json_buf")->set_text(exp.getConfig().dump(4));
-            stopDataCollecting();
-
-            if(exp.getReceiverHandler())
-                curRecvHandler = &(exp.getReceiverHandler()->get());
-            else
-                curRecvHandler = nullptr;
-
-            if(exp.getPreprocessor())
-                curPreprocessor = &(exp.getPreprocessor()->get());
-            else
-                curPreprocessor = nullptr;
-
-            updatePlot();
-            update_extra_info();
-        }
-        catch(const std::out_of_range& ex) {
-            std::cerr << "Something went wrong and selected experiment is out of range of available experiments" << std::endl;
-        }
-        catch(const std::exception& ex) {
-            std::cerr << "Exception during updating info about new selected experiment: " << ex.what() << std::endl;
-        }
-        catch(...) {
-            std::cerr << "Unknown exception during updating info about new selected experiment" << std::endl;
-        }
+        //the row and the experiment are read by QueryExecutor if they aren't loaded yet
+        ExperimentsList::getInstance().requestExperimentByIdx(pos, [pos](Experiment& exp) {
+            if(main_window_selected_exp != pos)
+                return;
+            showSelectedExperiment(exp);
+        });
     });
 
     getWidget<Gtk::Button>("main_window_update_list")->signal_clicked().connect(&updateMainWindow);
 
-    ExperimentsList::getInstance().updateSignal().connect([](){
+    //the list view asks only for the rows it shows, their names are read in pages
+    auto experimentsModel = ExperimentsListModel::create();
+    getObject<Gtk::SingleSelection>("main_window_exp_list_selection")->set_model(experimentsModel);
+
+    ExperimentsList::getInstance().updateSignal().connect([experimentsModel](){
         auto clearEntry = [](std::string_view name) {
             getWidget<Gtk::Entry>(name.data())->get_buffer()->set_text("");
         };
@@ -680,10 +928,10 @@ void main_window_process(Glib::RefPtr<Gtk::Builder> pBuilder)
         getObject<Gtk::TextBuffer>("main_exp_desc_buffer")->set_text("");
         stopDataCollecting();
 
-        std::vector<Glib::ustring> names = ExperimentsList::getInstance().getExperimentsNames();
-        getObject<Gtk::SingleSelection>("main_window_exp_list_selection")->set_model(Gtk::StringList::create(names));
+        experimentsModel->reset();
 
         main_window_selected_exp = GTK_INVALID_LIST_POSITION;
+        cancelExperimentQueries();
     });
 
     getWidget<Gtk::Button>("main_window_delete_bn")->signal_clicked().connect([](){
@@ -691,6 +939,7 @@ void main_window_process(Glib::RefPtr<Gtk::Builder> pBuilder)
             if(main_window_selected_exp == GTK_INVALID_LIST_POSITION)
                 return;
 
+            stopDataCollecting();
             ExperimentsList::getInstance().deleteExperiment(main_window_selected_exp);
         }
         catch(const std::out_of_range& ex) {
@@ -802,10 +1051,11 @@ void main_window_process(Glib::RefPtr<Gtk::Builder> pBuilder)
         getWidget<Gtk::Entry>("main_window_marker_entry")->get_buffer()->set_text(marker);
     });
 
-    getWidget<Gtk::SpinButton>("main_window_subcar_sb")->signal_value_changed().connect(&updatePlot);
-    getWidget<Gtk::SpinButton>("main_window_recv_ant_sb")->signal_value_changed().connect(&updatePlot);
-    getWidget<Gtk::SpinButton>("main_window_trans_ant_sb")->signal_value_changed().connect(&updatePlot);
-    getWidget<Gtk::DropDown>("main_window_drawed_data_type")->property_selected().signal_changed().connect(&updatePlot);
+    getWidget<Gtk::SpinButton>("main_window_subcar_sb")->signal_value_changed().connect(&onPlotSelectionChanged);
+    getWidget<Gtk::SpinButton>("main_window_recv_ant_sb")->signal_value_changed().connect(&onPlotSelectionChanged);
+    getWidget<Gtk::SpinButton>("main_window_trans_ant_sb")->signal_value_changed().connect(&onPlotSelectionChanged);
+    getWidget<Gtk::DropDown>("main_window_drawed_data_type")->property_selected().signal_changed().connect(&onPlotSelectionChanged);
+    readPlotSelection();
 
     getWidget<Gtk::AspectFrame>("main_window_plot_ratio_frame")->set_child(*plot);
 
@@ -814,10 +1064,12 @@ void main_window_process(Glib::RefPtr<Gtk::Builder> pBuilder)
     conButtonWindow("import_window_button", "import_window");
     conButtonWindow("main_window_extra_info_bn", "extra_info_window");
     conButtonWindow("export_window_button", "export_window");
+    conButtonWindow("main_window_stats_bn", "stats_window");
 }
 
 void on_app_activate()
 {
+  const auto activateStart = StartupLog::clock::now();
   // Load the GtkBuilder file and instantiate its widgets:
   auto refBuilder = Gtk::Builder::create();
   try
@@ -840,6 +1092,7 @@ void on_app_activate()
     return;
   }
   pBuilder = refBuilder;
+  PROFILE_THREAD_NAME("ui");
 
   // Get the GtkBuilder-instantiated dialog:
   pMainWindow = refBuilder->get_widget<Gtk::Window>("main_window");
@@ -851,6 +1104,9 @@ void on_app_activate()
 
 
   pMainWindow->signal_hide().connect([] () {
+    catalogLoad.reset();    //waits for the database, its callback isn't run anymore
+    metricsExporter.stop();
+    ExperimentsList::getInstance().flushRollups();
     delete pMainWindow;
     app->quit();
   });
@@ -861,23 +1117,70 @@ void on_app_activate()
 
   app->add_window(*pMainWindow);
   pMainWindow->set_visible(true);
+  startupLog.stage("main window", activateStart);
 
   plot = std::make_shared<ExtendablePlot>();
   dataToDraw = std::make_shared<DataSet>();
+  dataToDraw->setWindow(plotWindowPoints);
   plot->addDataSet(dataToDraw);
 
-  main_window_process(refBuilder);
-  hardware_window_process();
-  import_window_process();
-  experiment_window_process();
-  export_window_process();
-
-  Glib::signal_idle().connect(&pipelineWorker);
+  //the window is shown at once, widgets are connected when the database and
+  //the hardware catalog are loaded in the background
+  pMainWindow->set_sensitive(false);
+  catalogLoad = std::make_unique<BackgroundTask>(
+    []() {
+      auto start = StartupLog::clock::now();
+      DB_Handler::get_db();
+      startupLog.stage("database", start);
+      start = StartupLog::clock::now();
+      HW_List::get_instance();
+      startupLog.stage("hardware catalog", start);
+    },
+    [refBuilder]() {
+      auto start = StartupLog::clock::now();
+      main_window_process(refBuilder);
+      hardware_window_process();
+      import_window_process();
+      experiment_window_process();
+      export_window_process();
+      stats_window_process();
+      deletion_process();
+
+      CapturePipeline::frameBus();    //creates the live frame bus if DBC_FRAME_BUS is set
+      QueryExecutor::getInstance();   //its dispatcher has to be created in the UI thread
+      Glib::signal_idle().connect(&pipelineWorker);
+      pMainWindow->set_sensitive(true);
+      startupLog.stage("widgets", start);
+
+      auto listStart = StartupLog::clock::now();
+      auto listLoaded = std::make_shared<sigc::connection>();
+      *listLoaded = ExperimentsList::getInstance().updateSignal().connect([listStart, listLoaded]() {
+        startupLog.stage("experiments list", listStart);
+        listLoaded->disconnect();
+      });
+      updateMainWindow();
+    });
 
   std::filesystem::create_directory("images");
-  for (int i = 0; i < 16 && !camera.open(i); i++) {}
-  if(camera.isOpened())
-    Glib::signal_timeout().connect(&camera_worker, 1000);
+  auto foundCamera = std::make_shared<std::unique_ptr<cv::VideoCapture>>();
+  cameraProbe = std::make_unique<BackgroundTask>(
+    [foundCamera]() {
+      auto start = StartupLog::clock::now();
+      for(int i = 0; i < 16; i++) {
+        auto capture = std::make_unique<cv::VideoCapture>();
+        if(capture->open(i)) {
+          *foundCamera = std::move(capture);
+          break;
+        }
+      }
+      startupLog.stage(*foundCamera ? "camera probe" : "camera probe, no camera", start);
+    },
+    [foundCamera]() {
+      if(!*foundCamera)
+        return;
+      camera = std::move(*foundCamera);
+      Glib::signal_timeout().connect(&camera_worker, 1000);
+    });
 }
 } // anonymous namespace
 
@@ -1,21 +1,90 @@
 #include "DataSet.hpp"
 
+#include <algorithm>
+#include <numbers>
+
 void DataSet::addDataPoint(double x, double y) {
-    bool toSort = x < extr.maxX;
+    toExplicitX();
+    bool toSort = x < extr.maxX && !isWindowed();
     addPoint(x, y);
     if(toSort) {
         sort();
     }
 
+    revision++;
+    signalChanged.emit(*this);
+}
+
+void DataSet::addRawPoint(int16_t re, int16_t im) {
+    if(takesRaw())
+        addRaw(re, im);
+    else
+        addValue(rawValue(re, im));
+    revision++;
+    signalChanged.emit(*this);
+}
+
+bool DataSet::isRaw() const {
+    return raw;
+}
+
+//only extremums change, the points are uploaded as they are
+void DataSet::setRawView(RawView view) {
+    rawView = view;
+    if(raw && getNumberOfPoints() != 0) {
+        if(isWindowed())
+            updateWindowExtremums();
+        else
+            updateRawExtremums(minSquaredAmpl, maxSquaredAmpl);
+    }
     signalChanged.emit(*this);
 }
 
+DataSet::RawView DataSet::getRawView() const {
+    return rawView;
+}
+
+uint64_t DataSet::getRevision() const {
+    return revision;
+}
+
 void DataSet::clear() {
     extr = Extrems();
-    points.clear();
+    implicitX = true;
+    raw = false;
+    rawPoints.clear();
+    minSquaredAmpl = std::numeric_limits<double>::max();
+    maxSquaredAmpl = std::numeric_limits<double>::lowest();
+    revision++;
+    if(isWindowed()) {
+        points.resize(capacity * 2);
+        head = 0;
+        count = 0;
+        nextSeq = 0;
+        windowMaxX.clear();
+        windowMinX.clear();
+        windowMaxY.clear();
+        windowMinY.clear();
+    }
+    else {
+        points.clear();
+    }
     signalChanged.emit(*this);
 }
 
+void DataSet::setWindow(size_t maxPoints, double maxSpan) {
+    capacity = maxPoints;
+    maxSpanX = maxSpan;
+    points.clear();
+    points.shrink_to_fit();
+    rawPoints.shrink_to_fit();
+    clear();
+}
+
+bool DataSet::isWindowed() const {
+    return capacity != 0;
+}
+
 void DataSet::show(bool toDraw) {
     this->toDraw = toDraw;
     signalChanged.emit(*this);
@@ -39,16 +108,46 @@ sigc::signal<void(DataSet&)> DataSet::signalOnChanged() const {
 }
 
 size_t DataSet::getNumberOfPoints() const {
-    return points.size() / 2;
+    if(isWindowed())
+        return count;
+    if(raw)
+        return rawPoints.size() / 2;
+    return points.size() / stride();
+}
+
+bool DataSet::hasImplicitX() const {
+    return implicitX;
+}
+
+double DataSet::getFirstX() const {
+    if(implicitX)
+        return isWindowed() ? nextSeq - count : 0;
+    if(getNumberOfPoints() == 0)
+        return 0;
+    return isWindowed() ? points[head * 2] : points[0];
 }
 
 const double* DataSet::getFirstElementAddress() const {
+    if(raw)
+        return nullptr;
+    if(isWindowed())
+        return count ? &(points[head * stride()]) : nullptr;
     if(points.empty())
         return nullptr;
     return &(points[0]);
 }
 
+const int16_t* DataSet::getFirstRawAddress() const {
+    if(!raw || getNumberOfPoints() == 0)
+        return nullptr;
+    return isWindowed() ? &(rawPoints[head * 2]) : &(rawPoints[0]);
+}
+
 size_t DataSet::getSizeOfBuffer() const {
+    if(raw)
+        return sizeof(int16_t) * 2 * getNumberOfPoints();
+    if(isWindowed())
+        return sizeof(double) * count * stride();
     return sizeof(double) * points.size();
 }
 
@@ -69,6 +168,11 @@ void DataSet::sort() {
 }
 
 void DataSet::addPoint(double x, double y) {
+    if(isWindowed()) {
+        addWindowPoint(x, y);
+        return;
+    }
+
     points.push_back(x);
     points.push_back(y);
 
@@ -77,3 +181,216 @@ void DataSet::addPoint(double x, double y) {
     if(y > extr.maxY) extr.maxY = y;
     if(y < extr.minY) extr.minY = y;
 }
+
+//x is the index, so x extremums are known without tracking and nothing is ever sorted
+void DataSet::addY(double y) {
+    if(!isWindowed()) {
+        points.push_back(y);
+        extr.minX = 0;
+        extr.maxX = points.size() - 1;
+        if(y > extr.maxY) extr.maxY = y;
+        if(y < extr.minY) extr.minY = y;
+        return;
+    }
+
+    if(count == capacity)
+        dropOldest();
+
+    size_t pos = (head + count) % capacity;
+    points[pos] = y;
+    points[pos + capacity] = y;
+    count++;
+
+    uint64_t seq = nextSeq++;
+    windowMaxY.push(seq, y);
+    windowMinY.push(seq, y);
+
+    if(maxSpanX > 0) {
+        while(count > 1 && count - 1 > maxSpanX)
+            dropOldest();
+    }
+    updateWindowExtremums();
+}
+
+//stores x of every point, x extremums of the window start to be tracked
+void DataSet::toExplicitX() {
+    fromRaw();
+    if(!implicitX)
+        return;
+    implicitX = false;
+
+    std::vector<double> pairs;
+    if(!isWindowed()) {
+        pairs.reserve(points.size() * 2);
+        for(size_t i = 0; i < points.size(); i++) {
+            pairs.push_back(i);
+            pairs.push_back(points[i]);
+        }
+        points.swap(pairs);
+        return;
+    }
+
+    pairs.resize(capacity * 4);
+    uint64_t firstSeq = nextSeq - count;
+    for(size_t i = 0; i < count; i++) {
+        double x = firstSeq + i;
+        double y = points[head + i];
+        for(size_t copy : {i, i + capacity}) {
+            pairs[copy * 2] = x;
+            pairs[copy * 2 + 1] = y;
+        }
+        windowMaxX.push(firstSeq + i, x);
+        windowMinX.push(firstSeq + i, x);
+    }
+    points.swap(pairs);
+    head = 0;
+}
+
+void DataSet::addWindowPoint(double x, double y) {
+    if(count == capacity)
+        dropOldest();
+
+    size_t pos = (head + count) % capacity;
+    for(size_t copy : {pos, pos + capacity}) {
+        points[copy * 2] = x;
+        points[copy * 2 + 1] = y;
+    }
+    count++;
+
+    uint64_t seq = nextSeq++;
+    windowMaxX.push(seq, x);
+    windowMinX.push(seq, x);
+    windowMaxY.push(seq, y);
+    windowMinY.push(seq, y);
+
+    if(maxSpanX > 0) {
+        while(count > 1 && x - points[head * 2] > maxSpanX)
+            dropOldest();
+    }
+    updateWindowExtremums();
+}
+
+void DataSet::dropOldest() {
+    head = (head + 1) % capacity;
+    count--;
+
+    uint64_t firstSeq = nextSeq - count;
+    windowMaxX.evict(firstSeq);
+    windowMinX.evict(firstSeq);
+    windowMaxY.evict(firstSeq);
+    windowMinY.evict(firstSeq);
+}
+
+void DataSet::updateWindowExtremums() {
+    extr = Extrems();
+    if(count == 0)
+        return;
+    if(implicitX) {
+        extr.minX = nextSeq - count;
+        extr.maxX = nextSeq - 1;
+    }
+    else {
+        extr.maxX = windowMaxX.get();
+        extr.minX = windowMinX.get();
+    }
+    if(raw) {
+        updateRawExtremums(windowMinY.get(), windowMaxY.get());
+        return;
+    }
+    extr.maxY = windowMaxY.get();
+    extr.minY = windowMinY.get();
+}
+
+//an empty set starts to take raw points, a set with values keeps them
+bool DataSet::takesRaw() {
+    if(!raw && implicitX && getNumberOfPoints() == 0) {
+        raw = true;
+        if(isWindowed())
+            rawPoints.resize(capacity * 4);
+    }
+    return raw;
+}
+
+double DataSet::rawValue(int16_t re, int16_t im) const {
+    if(rawView == RawView::Phase)
+        return std::atan2(im, re);
+    return std::sqrt(static_cast<double>(re) * re + static_cast<double>(im) * im);
+}
+
+//only the squared amplitude is tracked, phase always spans -pi..pi
+void DataSet::addRaw(int16_t re, int16_t im) {
+    const double squaredAmpl = static_cast<double>(re) * re + static_cast<double>(im) * im;
+    if(!isWindowed()) {
+        rawPoints.push_back(re);
+        rawPoints.push_back(im);
+        minSquaredAmpl = std::min(minSquaredAmpl, squaredAmpl);
+        maxSquaredAmpl = std::max(maxSquaredAmpl, squaredAmpl);
+        extr.minX = 0;
+        extr.maxX = rawPoints.size() / 2 - 1;
+        updateRawExtremums(minSquaredAmpl, maxSquaredAmpl);
+        return;
+    }
+
+    if(count == capacity)
+        dropOldest();
+
+    size_t pos = (head + count) % capacity;
+    for(size_t copy : {pos, pos + capacity}) {
+        rawPoints[copy * 2] = re;
+        rawPoints[copy * 2 + 1] = im;
+    }
+    count++;
+
+    uint64_t seq = nextSeq++;
+    windowMaxY.push(seq, squaredAmpl);
+    windowMinY.push(seq, squaredAmpl);
+
+    if(maxSpanX > 0) {
+        while(count > 1 && count - 1 > maxSpanX)
+            dropOldest();
+    }
+    updateWindowExtremums();
+}
+
+void DataSet::updateRawExtremums(double minSquared, double maxSquared) {
+    if(rawView == RawView::Phase) {
+        extr.minY = -std::numbers::pi;
+        extr.maxY = std::numbers::pi;
+    }
+    else {
+        extr.minY = std::sqrt(minSquared);
+        extr.maxY = std::sqrt(maxSquared);
+    }
+}
+
+//adds y to a set that isn't raw, x follows the last one
+void DataSet::addValue(double y) {
+    if(implicitX)
+        addY(y);
+    else
+        addPoint(getNumberOfPoints() ? extr.maxX + 1 : 0, y);
+}
+
+//replaces raw points with their values in the current view, x of the points stays
+void DataSet::fromRaw() {
+    if(!raw)
+        return;
+    raw = false;
+    minSquaredAmpl = std::numeric_limits<double>::max();
+    maxSquaredAmpl = std::numeric_limits<double>::lowest();
+
+    std::vector<int16_t> rawCopy;
+    rawCopy.swap(rawPoints);
+    const size_t n = isWindowed() ? count : rawCopy.size() / 2;
+    const size_t first = isWindowed() ? head : 0;
+    extr = Extrems();
+    if(isWindowed()) {
+        nextSeq -= count;
+        head = 0;
+        count = 0;
+        windowMaxY.clear();
+        windowMinY.clear();
+    }
+    for(size_t i = 0; i < n; i++)
+        addY(rawValue(rawCopy[(first + i) * 2], rawCopy[(first + i) * 2 + 1]));
+}
@@ -0,0 +1,296 @@
+#include "PlotRenderer.hpp"
+#include "embedded_shaders.hpp"
+#include "profiler.hpp"
+
+#include <epoxy/gl.h>
+#include <iostream>
+#include <algorithm>
+
+void PlotRenderer::updateExtremums() {
+    DataSet::Extrems le;
+    for(auto& ds : datasets) {
+        auto extr = ds->getExtremums();
+
+        le.maxX = le.maxX > extr.maxX ? le.maxX : extr.maxX;
+        le.minX = le.minX < extr.minX ? le.minX : extr.minX;
+        le.maxY = le.maxY > extr.maxY ? le.maxY : extr.maxY;
+        le.minY = le.minY < extr.minY ? le.minY : extr.minY;
+    }
+
+    maxX = le.maxX;
+    minX = le.minX;
+    maxY = le.maxY;
+    minY = le.minY;
+}
+
+//shaders are embedded by tools/embed_shaders.sh, programs come from the binary cache after the first start
+void PlotRenderer::initShaders() {
+    PROFILE_ZONE("initShaders");
+    shader          = Shader::cached(EmbeddedShaders::VertShader, EmbeddedShaders::FragShader);
+    implicitXShader = Shader::cached(EmbeddedShaders::VertShaderImplicitX, EmbeddedShaders::FragShader);
+    rawShader       = Shader::cached(EmbeddedShaders::VertShaderRaw, EmbeddedShaders::FragShader);
+    textureShader   = Shader::cached(EmbeddedShaders::TextureVertShader, EmbeddedShaders::TextureFragShader);
+    dsBuffers.clear();      //belong to the previous context if the widget was realized again
+}
+
+PlotRenderer::OpenglDSBuffers::OpenglDSBuffers(const DataSet& dataSet) :
+    size(dataSet.getSizeOfBuffer()),
+    raw(dataSet.isRaw()),
+    implicitX(dataSet.hasImplicitX())
+{
+    glCreateBuffers(1, &VBO);
+    glCreateVertexArrays(1, &VAO);
+
+    if(dataSet.isRaw()) {
+        //4 bytes per point, converted to float for the shader
+        glNamedBufferStorage(VBO, dataSet.getSizeOfBuffer(), dataSet.getFirstRawAddress(), GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(int16_t) * 2);
+        glVertexArrayAttribFormat(VAO, 0, 2, GL_SHORT, false, 0);
+    }
+    else {
+        glNamedBufferStorage(VBO, dataSet.getSizeOfBuffer(), dataSet.getFirstElementAddress(), GL_DYNAMIC_STORAGE_BIT);
+
+        //with implicit x only y is uploaded, the shader takes x from gl_VertexID
+        const int components = dataSet.hasImplicitX() ? 1 : 2;
+        glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(double) * components);
+
+        glVertexArrayAttribFormat(VAO, 0, components, GL_DOUBLE, false, 0);  //sets format of attribute
+    }
+
+    glVertexArrayAttribBinding(VAO, 0, 0);
+}
+
+bool PlotRenderer::OpenglDSBuffers::update(const DataSet& dataSet) {
+    if(dataSet.getSizeOfBuffer() != size || dataSet.isRaw() != raw || dataSet.hasImplicitX() != implicitX)
+        return false;
+    const void* data = raw ? static_cast<const void*>(dataSet.getFirstRawAddress()) : static_cast<const void*>(dataSet.getFirstElementAddress());
+    glNamedBufferSubData(VBO, 0, size, data);
+    return true;
+}
+
+void PlotRenderer::OpenglDSBuffers::enable() {
+    glBindVertexArray(VAO);
+    glEnableVertexArrayAttrib(VAO, 0);
+}
+
+void PlotRenderer::OpenglDSBuffers::disable() {
+    glDisableVertexArrayAttrib(VAO, 0);
+}
+
+PlotRenderer::OpenglDSBuffers::~OpenglDSBuffers() {
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+PlotRenderer::OpenglCairoBuffer::OpenglCairoBuffer(const Cairo::ImageSurface& surface) {
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+
+    glTextureStorage2D(texture, 1, GL_RGBA8, surface.get_width(), surface.get_height());
+
+    glTextureSubImage2D(texture, 0, 0, 0, surface.get_width(), surface.get_height(), GL_BGRA, GL_UNSIGNED_BYTE, surface.get_data());
+
+    float vertices[] = {
+        -1.0, 1.0, 0.0, 0.0,
+        -1.0, -1.0, 0.0, 1.0,
+        1.0, 1.0, 1.0, 0.0,
+        1.0, -1.0, 1.0, 1.0
+    };
+
+    glCreateBuffers(1, &VBO);
+
+    glNamedBufferStorage(VBO, sizeof(vertices), vertices, GL_DYNAMIC_STORAGE_BIT);
+
+    glCreateVertexArrays(1, &VAO);
+
+    glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(float) * 4);
+
+    glVertexArrayAttribFormat(VAO, 0, 2, GL_FLOAT, false, 0);  //sets format of attribute
+    glVertexArrayAttribFormat(VAO, 1, 2, GL_FLOAT, false, sizeof(float) * 2);  //sets format of attribute
+
+    glVertexArrayAttribBinding(VAO, 0, 0);
+    glVertexArrayAttribBinding(VAO, 1, 0);
+}
+
+void PlotRenderer::OpenglCairoBuffer::enable() {
+    glBindVertexArray(VAO);
+    glEnableVertexArrayAttrib(VAO, 0);
+    glEnableVertexArrayAttrib(VAO, 1);
+    glBindTextureUnit(0, texture);
+}
+
+void PlotRenderer::OpenglCairoBuffer::disable() {
+    glDisableVertexArrayAttrib(VAO, 0);
+    glDisableVertexArrayAttrib(VAO, 1);
+}
+
+PlotRenderer::OpenglCairoBuffer::~OpenglCairoBuffer() {
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteTextures(1, &texture);
+}
+
+PlotRenderer::OpenglDSBuffers& PlotRenderer::buffersOf(const DataSet& data) {
+    CachedDSBuffers& cached = dsBuffers[&data];
+    if(!cached.buffers || cached.revision != data.getRevision()) {
+        PROFILE_ZONE("upload");
+        if(!cached.buffers || !cached.buffers->update(data)) {
+            cached.buffers.reset();
+            cached.buffers = std::make_unique<OpenglDSBuffers>(data);
+        }
+        cached.revision = data.getRevision();
+    }
+    return *cached.buffers;
+}
+
+void PlotRenderer::drawDataSet(const DataSet& data, Gdk::RGBA color, EdgePositions edgePos) {
+    PROFILE_ZONE("drawDataSet");
+    glBindVertexArray(0);
+    OpenglDSBuffers& buffer = buffersOf(data);
+
+    unsigned int program = data.isRaw() ? rawShader : data.hasImplicitX() ? implicitXShader : shader;
+    glUseProgram(program);
+    buffer.enable();
+
+    if(data.hasImplicitX()) {
+        int xOffsetLoc = glGetUniformLocation(program, "xOffset");
+        glUniform1d(xOffsetLoc, data.getFirstX());
+    }
+    //switching between amplitude and phase is only this uniform
+    if(data.isRaw()) {
+        int phaseLoc = glGetUniformLocation(program, "phase");
+        glUniform1i(phaseLoc, data.getRawView() == DataSet::RawView::Phase);
+    }
+
+    double xMult = (edgePos.right - edgePos.left) / (maxX - minX);
+    double xShift = edgePos.left - xMult * minX;
+    int xMultLoc = glGetUniformLocation(program, "xMult");
+    glUniform1d(xMultLoc, xMult);
+    int xShiftLoc = glGetUniformLocation(program, "xShift");
+    glUniform1d(xShiftLoc, xShift);
+
+    double yMult = (edgePos.up - edgePos.down) / (maxY - minY);
+    double yShift = edgePos.down - yMult * minY;
+    int yMultLoc = glGetUniformLocation(program, "yMult");
+    glUniform1d(yMultLoc, yMult);
+    int yShiftLoc = glGetUniformLocation(program, "yShift");
+    glUniform1d(yShiftLoc, yShift);
+
+    int colorLoc = glGetUniformLocation(program, "color");
+    glUniform4f(colorLoc, color.get_red(), color.get_green(), color.get_blue(), color.get_alpha());
+
+    glDrawArrays(GL_LINE_STRIP, 0, data.getNumberOfPoints());
+}
+
+void PlotRenderer::drawLegend(size_t windowWidth, size_t windowHeight, EdgePositions pos) {
+    PROFILE_ZONE("drawLegend");
+    auto surface = Cairo::ImageSurface::create(Cairo::Surface::Format::ARGB32, windowWidth, windowHeight);
+    auto cr = Cairo::Context::create(surface);
+
+    pos.down = -pos.down;  //because cairo's and opengl's ordinate
+    pos.up   = -pos.up;    //coordinates are opposite
+
+    pos.up    = (pos.up + 1)    * windowHeight / 2;//transform opengl's coordinate system
+    pos.right = (pos.right + 1) * windowWidth  / 2;//into cairo's one
+    pos.down  = (pos.down + 1)  * windowHeight / 2;
+    pos.left  = (pos.left + 1)  * windowWidth  / 2;
+
+    cr->set_source_rgba(1, 1, 1, 0);    //make white transparent background
+    cr->paint();
+
+    cr->set_source_rgb(0, 0, 0);        //draw box around
+    cr->set_line_width(4);
+    cr->rectangle(pos.left, pos.down, pos.right - pos.left, pos.up - pos.down);
+    cr->stroke();
+
+    auto font = Cairo::ToyFontFace::create("", Cairo::ToyFontFace::Slant::NORMAL, Cairo::ToyFontFace::Weight::NORMAL);
+    cr->set_font_face(font);
+    cr->set_font_size(20);
+
+    Cairo::TextExtents te;
+
+    std::string maxYStr = std::to_string(static_cast<long long>(maxY));
+    cr->get_text_extents(maxYStr, te);
+    double maxYPosX = pos.left - te.width - 5;
+    double maxYPosY = pos.up + te.height;
+    cr->move_to(maxYPosX, maxYPosY);
+    cr->show_text(maxYStr);
+
+    std::string minYStr = std::to_string(static_cast<long long>(minY));
+    cr->get_text_extents(minYStr, te);
+    double minYPosX = pos.left - te.width - 5;
+    double minYPosY = pos.down;
+    cr->move_to(minYPosX, minYPosY);
+    cr->show_text(minYStr);
+
+    std::string minXStr = std::to_string(static_cast<long long>(minX));
+    cr->get_text_extents(minXStr, te);
+    double minXPosX = pos.left;
+    double minXPosY = pos.down + te.height + 5;
+    cr->move_to(minXPosX, minXPosY);
+    cr->show_text(minXStr);
+
+    std::string maxXStr = std::to_string(static_cast<long long>(maxX));
+    cr->get_text_extents(maxXStr, te);
+    double maxXPosX = pos.right - te.width;
+    double maxXPosY = pos.down + te.height + 5;
+    cr->move_to(maxXPosX, maxXPosY);
+    cr->show_text(maxXStr);
+
+    glUseProgram(textureShader);
+    glBindVertexArray(0);
+    OpenglCairoBuffer buffer(*surface);
+    buffer.enable();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void PlotRenderer::renderScene(size_t windowWidth, size_t windowHeight) {
+    Gdk::RGBA foreground(0.0, 0.0, 0.0, 1.0), background(1.0, 1.0, 1.0, 1.0);
+
+    glBlendFunc(GL_SRC_COLOR,  GL_ONE_MINUS_SRC_ALPHA);
+    glEnable( GL_BLEND );
+
+    glClearColor(background.get_red(),
+                 background.get_green(),
+                 background.get_blue(),
+                 background.get_alpha());
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    double width = windowWidth;
+    double height = windowHeight;
+    EdgePositions graphBox {1.0 - up_reserve / height / 2.0,
+                            1.0 - right_reserve / width / 2.0,
+                            -1.0 + down_reserve / height / 2.0,
+                            -1.0 + left_reserve / width / 2.0};
+
+    auto lastMaxX = maxX;
+    auto lastMinX = minX;
+    auto lastMaxY = maxY;
+    auto lastMinY = minY;
+
+    std::erase_if(dsBuffers, [this](const auto& cached) {
+        return std::none_of(datasets.begin(), datasets.end(), [&cached](const auto& ds) { return ds.get() == cached.first; });
+    });
+    for(auto& ds : datasets) {
+        if(ds->getNumberOfPoints() >= 2)
+            drawDataSet(*ds, ds->getColor(), graphBox);
+    }
+
+    //the legend shows the x range that's drawn, windowed datasets don't start at 0
+    if(maxX == std::numeric_limits<double>::lowest()) maxX = 0;
+    if(minX == std::numeric_limits<double>::max())    minX = 0;
+    if(maxY == std::numeric_limits<double>::lowest()) maxY = 0;
+    if(minY == std::numeric_limits<double>::max())    minY = 0;
+
+    drawLegend(windowWidth, windowHeight, graphBox);
+    glFlush();
+
+    maxX = lastMaxX;
+    minX = lastMinX;
+    maxY = lastMaxY;
+    minY = lastMinY;
+
+    int err = glGetError();
+    if(err != GL_NO_ERROR) {
+        std::cerr << "Error: " << err << std::endl;
+    }
+}
@@ -1,7 +1,109 @@
 #include "Shader.hpp"
 
 #include <epoxy/gl.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::filesystem::path shaderCacheDir() {
+    const char* xdgCache = std::getenv("XDG_CACHE_HOME");
+    if(xdgCache && *xdgCache)
+        return std::filesystem::path(xdgCache) / "db_collector" / "shaders";
+    const char* home = std::getenv("HOME");
+    if(home && *home)
+        return std::filesystem::path(home) / ".cache" / "db_collector" / "shaders";
+    return {};
+}
+
+//FNV-1a, stable between runs unlike std::hash
+uint64_t hashString(uint64_t hash, const char* str) {
+    for(; *str; str++) {
+        hash ^= static_cast<unsigned char>(*str);
+        hash *= 1099511628211ull;
+    }
+    return hash ^ 0xff;    //separates the strings
+}
+
+//binaries are valid only for the driver that built them, so it's a part of the key
+std::string cacheKey(const char* vertShaderProg, const char* fragShaderProg) {
+    uint64_t hash = 14695981039346656037ull;
+    for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* str = reinterpret_cast<const char*>(glGetString(name));
+        hash = hashString(hash, str ? str : "");
+    }
+    hash = hashString(hash, vertShaderProg);
+    hash = hashString(hash, fragShaderProg);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return name;
+}
+
+//program from a cache file: GLenum format followed by the binary, 0 if there's no usable one
+unsigned int loadProgramBinary(const std::filesystem::path& file) {
+    std::ifstream stream(file, std::ios::binary);
+    if(!stream)
+        return 0;
+    GLenum format = 0;
+    stream.read(reinterpret_cast<char*>(&format), sizeof(format));
+    std::vector<char> binary((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if(!stream.eof() || binary.empty())
+        return 0;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), binary.size());
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success) {
+        //the driver may reject binaries after an update even with the same version string
+        glDeleteProgram(program);
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+        return 0;
+    }
+    return program;
+}
+
+void storeProgramBinary(const std::filesystem::path& file, unsigned int program) {
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code ec;
+    std::filesystem::create_directories(file.parent_path(), ec);
+    if(ec) {
+        std::cerr << "Unable to create shader cache " << file.parent_path() << ": " << ec.message() << std::endl;
+        return;
+    }
+    //written aside and renamed, so another instance never reads half a file
+    std::filesystem::path tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream stream(tmp, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        stream.write(binary.data(), length);
+        if(!stream) {
+            std::cerr << "Unable to write shader cache " << tmp << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, file, ec);
+    if(ec)
+        std::cerr << "Unable to write shader cache " << file << ": " << ec.message() << std::endl;
+}
+
+} // anonymous namespace
 
 Shader::Shader(const char* vertShaderProg, const char* fragShaderProg) :
     id(nullptr,
@@ -43,6 +145,7 @@ Shader::Shader(const char* vertShaderProg, const char* fragShaderProg) :
     }
 
     unsigned int completeShader = glCreateProgram();
+    glProgramParameteri(completeShader, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glAttachShader(completeShader, vertShader);
     glAttachShader(completeShader, fragShader);
     glLinkProgram(completeShader);
@@ -74,6 +177,28 @@ Shader::Shader(const char* vertShaderProg, const char* fragShaderProg) :
     return;
 }
 
+Shader::Shader(unsigned int program) :
+    id(std::make_shared<unsigned int>(program)),
+    isOk(true)
+{}
+
+Shader Shader::cached(const char* vertShaderProg, const char* fragShaderProg) {
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    std::filesystem::path dir = shaderCacheDir();
+    if(formats == 0 || dir.empty())
+        return Shader(vertShaderProg, fragShaderProg);
+
+    std::filesystem::path file = dir / (cacheKey(vertShaderProg, fragShaderProg) + ".bin");
+    if(unsigned int program = loadProgramBinary(file))
+        return Shader(program);
+
+    Shader shader(vertShaderProg, fragShaderProg);
+    if(shader)
+        storeProgramBinary(file, shader);
+    return shader;
+}
+
 Shader::operator bool() {
     return isOk;
 }
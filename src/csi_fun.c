@@ -138,10 +138,10 @@ int read_csi_buf(unsigned char* buf_addr,int fd, int BUFSIZE){
 void record_status(unsigned char* buf_addr, int cnt, csi_struct* csi_status){
     if (is_big_endian()){
         csi_status->tstamp  =
-            ((buf_addr[0] << 56) & 0x00000000000000ff) | ((buf_addr[1] << 48) & 0x000000000000ff00) |
-            ((buf_addr[2] << 40) & 0x0000000000ff0000) | ((buf_addr[3] << 32) & 0x00000000ff000000) |
-            ((buf_addr[4] << 24) & 0x000000ff00000000) | ((buf_addr[5] << 16) & 0x0000ff0000000000) |
-            ((buf_addr[6] << 8)  & 0x00ff000000000000) | ((buf_addr[7])       & 0xff00000000000000) ;
+            ((u_int64_t)buf_addr[0] << 56) | ((u_int64_t)buf_addr[1] << 48) |
+            ((u_int64_t)buf_addr[2] << 40) | ((u_int64_t)buf_addr[3] << 32) |
+            ((u_int64_t)buf_addr[4] << 24) | ((u_int64_t)buf_addr[5] << 16) |
+            ((u_int64_t)buf_addr[6] << 8)  |  (u_int64_t)buf_addr[7];
         csi_status->csi_len = ((buf_addr[8] << 8) & 0xff00) | (buf_addr[9] & 0x00ff);
         csi_status->channel = ((buf_addr[10] << 8) & 0xff00) | (buf_addr[11] & 0x00ff);
         csi_status->buf_len = ((buf_addr[cnt-2] << 8) & 0xff00) | (buf_addr[cnt-1] & 0x00ff);
@@ -149,10 +149,10 @@ void record_status(unsigned char* buf_addr, int cnt, csi_struct* csi_status){
             ((buf_addr[csi_st_len + 1]) & 0x00ff);
     }else{
         csi_status->tstamp  =
-            ((buf_addr[7] << 56) & 0x00000000000000ff) | ((buf_addr[6] << 48) & 0x000000000000ff00) |
-            ((buf_addr[5] << 40) & 0x0000000000ff0000) | ((buf_addr[4] << 32) & 0x00000000ff000000) |
-            ((buf_addr[3] << 24) & 0x000000ff00000000) | ((buf_addr[2] << 16) & 0x0000ff0000000000) |
-            ((buf_addr[1] << 8)  & 0x00ff000000000000) | ((buf_addr[0])       & 0xff00000000000000) ;
+            ((u_int64_t)buf_addr[7] << 56) | ((u_int64_t)buf_addr[6] << 48) |
+            ((u_int64_t)buf_addr[5] << 40) | ((u_int64_t)buf_addr[4] << 32) |
+            ((u_int64_t)buf_addr[3] << 24) | ((u_int64_t)buf_addr[2] << 16) |
+            ((u_int64_t)buf_addr[1] << 8)  |  (u_int64_t)buf_addr[0];
         csi_status->csi_len = ((buf_addr[9] << 8) & 0xff00) | (buf_addr[8] & 0x00ff);
 
         csi_status->channel = ((buf_addr[11] << 8) & 0xff00) | (buf_addr[10] & 0x00ff);
@@ -0,0 +1,423 @@
+//Headless capture daemon.
+//Runs the receive -> preprocess -> store pipeline of the GUI without GTK,
+//for collection boxes without a display. Uses database.db of the working
+//directory, like the GUI. While running it is controlled over a unix
+//socket, one command per line:
+//  status          JSON with the state and metrics of the capture
+//  marker TEXT     sets the marker of the following packets
+//  pause, resume   stops and resumes storing frames
+//  stop            stops the daemon
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "capture_pipeline.hpp"
+#include "metrics_exporter.hpp"
+
+namespace
+{
+std::atomic<bool> stopRequested = false;
+
+struct Options {
+    std::optional<int32_t> experiment;      //database id
+    std::string newName;                    //creates a new experiment instead
+    std::string receiver;                   //name or index, the experiment's one if empty
+    std::string preprocessor;               //name or index, the experiment's one if empty
+    std::optional<nlohmann::json> config;
+    std::string control;                    //control socket path
+    std::optional<std::string> marker;
+    CapturePipeline::Settings pipeline;
+    double duration = 0;                    //seconds, 0 means until stopped
+    bool list = false;
+};
+
+void printUsage(const char* name) {
+    std::cout << "Usage: " << name << " (--experiment ID | --new NAME) [options]\n"
+              << "  --experiment ID    captures into the experiment with database id ID\n"
+              << "  --new NAME         creates a new experiment and captures into it\n"
+              << "  --receiver NAME    receiver handler, name or index (the experiment's one)\n"
+              << "  --preprocessor N   preprocessing handler, name or index (the experiment's one)\n"
+              << "  --config JSON      experiment config, replaces the stored one\n"
+              << "  --cpu N            pins the capture thread to core N (not pinned)\n"
+              << "  --batch N          frames per transaction (256)\n"
+              << "  --flush MS         commits at least every MS milliseconds (100)\n"
+              << "  --marker TEXT      initial marker\n"
+              << "  --control PATH     unix socket for status/marker/pause/resume/stop commands\n"
+              << "  --duration SEC     stop after SEC seconds (0 = never)\n"
+              << "  --list             prints experiments and handlers and exits\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for(int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if(key == "--help" || key == "-h") {
+            printUsage(argv[0]);
+            return false;
+        }
+        if(key == "--list") {
+            opt.list = true;
+            continue;
+        }
+        if(i + 1 >= argc) {
+            std::cerr << "Missing value for " << key << std::endl;
+            return false;
+        }
+        std::string val = argv[++i];
+        try {
+            if(key == "--experiment")        opt.experiment = std::stoi(val);
+            else if(key == "--new")          opt.newName = val;
+            else if(key == "--receiver")     opt.receiver = val;
+            else if(key == "--preprocessor") opt.preprocessor = val;
+            else if(key == "--config")       opt.config = nlohmann::json::parse(val);
+            else if(key == "--cpu")          opt.pipeline.cpu = std::stoi(val);
+            else if(key == "--batch")        opt.pipeline.batch = std::stoul(val);
+            else if(key == "--flush")        opt.pipeline.flushMs = std::stoul(val);
+            else if(key == "--marker")       opt.marker = val;
+            else if(key == "--control")      opt.control = val;
+            else if(key == "--duration")     opt.duration = std::stod(val);
+            else {
+                std::cerr << "Unknown option " << key << std::endl;
+                return false;
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "Incorrect value for " << key << ": " << val << std::endl;
+            return false;
+        }
+    }
+
+    if(opt.list)
+        return true;
+    if(opt.experiment.has_value() == !opt.newName.empty()) {
+        std::cerr << "Exactly one of --experiment and --new is needed" << std::endl;
+        return false;
+    }
+    if(opt.pipeline.batch == 0) {
+        std::cerr << "batch must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//handler by its index in the list or by its name, nullptr if key is empty
+ReceiverHandler* findReceiver(const std::string& key) {
+    if(key.empty())
+        return nullptr;
+    HandlersList& handlers = HandlersList::getInstance();
+    if(key.find_first_not_of("0123456789") == std::string::npos)
+        return &handlers.getRecvHandler(std::stoul(key));
+    return &handlers.getRecvHandler(Glib::ustring(key));
+}
+
+PreprocessingHandler* findPreprocessor(const std::string& key) {
+    if(key.empty())
+        return nullptr;
+    HandlersList& handlers = HandlersList::getInstance();
+    if(key.find_first_not_of("0123456789") == std::string::npos)
+        return &handlers.getPreprocHandler(std::stoul(key));
+    return &handlers.getPreprocHandler(Glib::ustring(key));
+}
+
+void printList() {
+    HandlersList& handlers = HandlersList::getInstance();
+    std::cout << "Receivers:\n";
+    auto recvNames = handlers.getRecvNames();
+    for(size_t i = 0; i < recvNames.size(); i++) {
+        std::cout << "  " << i << ": " << recvNames[i] << "\n";
+    }
+    std::cout << "Preprocessors:\n";
+    auto preprocNames = handlers.getPreprocNames();
+    for(size_t i = 0; i < preprocNames.size(); i++) {
+        std::cout << "  " << i << ": " << preprocNames[i] << "\n";
+    }
+    std::cout << "Experiments:\n";
+    ExperimentsList& list = ExperimentsList::getInstance();
+    for(size_t i = 0; i < list.getExperimentsCount(); i++) {
+        Experiment& exp = list.getExperimentByIdx(i);
+        std::cout << "  " << exp.getDBIndex() << ": " << exp.getName();
+        if(exp.getReceiverHandler())
+            std::cout << " [" << exp.getReceiverHandler()->get().getName() << "]";
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
+}
+
+struct Capture {
+    Experiment* exp = nullptr;
+    ReceiverHandler* recv = nullptr;
+    PreprocessingHandler* preproc = nullptr;
+};
+
+//finds or creates the experiment, handlers from the command line override its own ones
+std::optional<Capture> selectExperiment(const Options& opt) {
+    ExperimentsList& list = ExperimentsList::getInstance();
+    Capture capture;
+    capture.recv = findReceiver(opt.receiver);
+    capture.preproc = findPreprocessor(opt.preprocessor);
+
+    if(!opt.newName.empty()) {
+        FullExperimentConfig conf;
+        conf.name = opt.newName;
+        if(capture.recv)
+            conf.recvHandler = *capture.recv;
+        if(capture.preproc)
+            conf.preprocHandler = *capture.preproc;
+        conf.config = opt.config.value_or(nlohmann::json::object());
+        capture.exp = &list.addExperiment(conf);
+        capture.exp->setConfig(conf.config);
+    }
+    else {
+        try {
+            capture.exp = &list.getExperimentById(*opt.experiment);
+        }
+        catch(const std::out_of_range& ex) {
+            std::cerr << "No experiment with id " << *opt.experiment << std::endl;
+            return std::nullopt;
+        }
+        if(opt.config)
+            capture.exp->setConfig(*opt.config);
+    }
+
+    if(capture.recv == nullptr && capture.exp->getReceiverHandler())
+        capture.recv = &capture.exp->getReceiverHandler()->get();
+    if(capture.preproc == nullptr && capture.exp->getPreprocessor())
+        capture.preproc = &capture.exp->getPreprocessor()->get();
+    if(capture.recv == nullptr) {
+        std::cerr << "The experiment has no receiver handler, set one with --receiver" << std::endl;
+        return std::nullopt;
+    }
+    return capture;
+}
+
+//Serves the control socket on a thread of its own, the way MetricsExporter
+//serves metrics. Commands touching the database are posted to the pipeline.
+class ControlServer {
+public:
+    ControlServer(CapturePipeline& pipeline, int32_t expId) :
+        pipeline(pipeline),
+        expId(expId)
+    {}
+
+    ~ControlServer() {
+        stop();
+    }
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    bool start(const std::string& path) {
+        sockaddr_un addr {};
+        if(path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "ControlServer: socket path is too long " << path << std::endl;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        std::filesystem::remove(path);
+        if(listenFd < 0 ||
+           bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+           listen(listenFd, 4) != 0)
+        {
+            std::cerr << "ControlServer: unable to listen on " << path << ": " << std::strerror(errno) << std::endl;
+            if(listenFd >= 0)
+                close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        socketPath = path;
+        worker = std::jthread([this](std::stop_token stoken) { work(stoken); });
+        return true;
+    }
+
+    void stop() {
+        if(worker.joinable()) {
+            worker.request_stop();
+            worker.join();
+        }
+        if(listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+            std::filesystem::remove(socketPath);
+        }
+    }
+
+private:
+    static constexpr size_t maxLine = 4096;
+
+    CapturePipeline& pipeline;
+    int32_t expId;
+    std::jthread worker;
+    int listenFd = -1;
+    std::string socketPath;
+
+    std::string execute(const std::string& line) {
+        std::string command = line.substr(0, line.find(' '));
+        std::string arg = line.size() > command.size() ? line.substr(command.size() + 1) : "";
+
+        if(command == "status") {
+            Metrics& metrics = Metrics::getInstance();
+            nlohmann::json js;
+            js["experiment_id"] = expId;
+            js["running"] = pipeline.isRunning();
+            js["paused"] = pipeline.isPaused();
+            for(size_t i = 0; i < Metrics::counterNames.size(); i++) {
+                js["counters"][Metrics::counterNames[i]] = metrics.get(static_cast<Metrics::Counter>(i));
+            }
+            const LatencyHistogram& addPoint = metrics.getHistogram(Metrics::Stage::AddPoint);
+            js["add_point_p99_ns"] = addPoint.percentile(0.99);
+            return js.dump();
+        }
+        if(command == "marker") {
+            pipeline.post([arg]() { MarkerManager::getInstance().setMarker(arg); });
+            return "ok";
+        }
+        if(command == "pause" || command == "resume") {
+            pipeline.setPaused(command == "pause");
+            return "ok";
+        }
+        if(command == "stop") {
+            stopRequested = true;
+            return "ok";
+        }
+        return "error: unknown command " + command;
+    }
+
+    void serveClient(int client) {
+        std::string buffer;
+        char chunk[512];
+        while(true) {
+            pollfd pfd {client, POLLIN, 0};
+            if(poll(&pfd, 1, 1000) <= 0)
+                return;
+            ssize_t n = recv(client, chunk, sizeof(chunk), 0);
+            if(n <= 0)
+                return;
+            buffer.append(chunk, n);
+
+            size_t end;
+            while((end = buffer.find('\n')) != std::string::npos) {
+                std::string line = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+                if(!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                std::string reply = execute(line) + "\n";
+                size_t sent = 0;
+                while(sent < reply.size()) {
+                    ssize_t s = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+                    if(s <= 0)
+                        return;
+                    sent += s;
+                }
+            }
+            if(buffer.size() > maxLine)
+                return;
+        }
+    }
+
+    void work(std::stop_token stoken) {
+        while(!stoken.stop_requested()) {
+            pollfd pfd {listenFd, POLLIN, 0};
+            if(poll(&pfd, 1, 200) <= 0)
+                continue;
+            int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if(client < 0)
+                continue;
+            serveClient(client);
+            close(client);
+        }
+    }
+};
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if(!parseOptions(argc, argv, opt))
+        return 1;
+
+    std::signal(SIGINT, [](int) { stopRequested = true; });
+    std::signal(SIGTERM, [](int) { stopRequested = true; });
+
+    ExperimentsList& list = ExperimentsList::getInstance();
+    std::optional<Capture> capture;
+    try {
+        list.updateList(ExperimentsList::Filter());
+        if(opt.list) {
+            printList();
+            return 0;
+        }
+        capture = selectExperiment(opt);
+        if(capture) {
+            capture->recv->set_settings(capture->exp->getConfig());
+            if(capture->preproc)
+                capture->preproc->set_settings(capture->exp->getConfig());
+            if(opt.marker)
+                MarkerManager::getInstance().setMarker(*opt.marker);
+        }
+    }
+    catch(const std::out_of_range& ex) {
+        std::cerr << "No such handler, see --list" << std::endl;
+        return 1;
+    }
+    catch(const std::exception& ex) {
+        std::cerr << "Failed to open the experiment: " << ex.what() << std::endl;
+        return 1;
+    }
+    if(!capture)
+        return 1;
+    Experiment& exp = *capture->exp;
+    ReceiverHandler& recv = *capture->recv;
+
+    MetricsExporter metricsExporter;
+    if(auto settings = MetricsExporter::settingsFromEnv())
+        metricsExporter.start(*settings);
+    CapturePipeline::frameBus();    //creates the live frame bus if DBC_FRAME_BUS is set
+
+    std::cout << "capturing into experiment " << exp.getDBIndex() << " (" << exp.getName() << ") with "
+              << recv.getName() << std::endl;
+    recv.set_pause(false);
+
+    CapturePipeline pipeline;
+    pipeline.start(exp, recv, capture->preproc, opt.pipeline);
+    {
+        ControlServer control(pipeline, exp.getDBIndex());
+        if(!opt.control.empty() && !control.start(opt.control))
+            stopRequested = true;
+
+        const auto start = std::chrono::steady_clock::now();
+        while(!stopRequested && pipeline.isRunning()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(opt.duration > 0 && elapsed >= opt.duration)
+                break;
+        }
+    }
+    pipeline.stop();
+    recv.set_pause(true);
+    metricsExporter.stop();
+
+    try {
+        list.flushRollups();
+    }
+    catch(const std::exception& ex) {
+        std::cerr << "Failed to flush the experiment: " << ex.what() << std::endl;
+    }
+    std::cout << "stored " << Metrics::getInstance().get(Metrics::Counter::Stored) << " frames, dropped "
+              << Metrics::getInstance().get(Metrics::Counter::Drops) << " datagrams" << std::endl;
+    return 0;
+}
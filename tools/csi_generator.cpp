@@ -0,0 +1,195 @@
+//Synthetic CSI traffic generator.
+//Stands in for routers running the ath9k CSI tool and sends datagrams
+//to RouterReceiver, so the receiving side can be soak and throughput
+//tested over loopback without Atheros hardware.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <SFML/Network.hpp>
+
+#include "csi_encoder.hpp"
+
+namespace
+{
+std::atomic<bool> stopRequested = false;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    unsigned short port = 50000;
+    CsiPacketEncoder::Params params;
+    double rate = 1000;         //packets per second for every sender
+    size_t burst = 1;           //packets sent back to back before sleeping
+    size_t senders = 1;
+    double duration = 0;        //seconds, 0 means until interrupted
+    uint64_t count = 0;         //packets per sender, 0 means unlimited
+    uint64_t seed = 1;
+};
+
+void printUsage(const char* name) {
+    std::cout << "Usage: " << name << " [options]\n"
+              << "  --host ADDR        destination address (127.0.0.1)\n"
+              << "  --port N           destination port (50000)\n"
+              << "  --nr N             receiving antennas, 1..3 (3)\n"
+              << "  --nc N             transmitting antennas, 1..3 (3)\n"
+              << "  --tones N          subcarriers, 1..114 (56)\n"
+              << "  --payload N        payload length in bytes (1056)\n"
+              << "  --rate N           packets per second per sender (1000)\n"
+              << "  --burst N          packets per burst (1)\n"
+              << "  --senders N        concurrent senders (1)\n"
+              << "  --duration SEC     stop after SEC seconds (0 = never)\n"
+              << "  --count N          stop every sender after N packets (0 = never)\n"
+              << "  --seed N           random seed (1)\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for(int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if(key == "--help" || key == "-h") {
+            printUsage(argv[0]);
+            return false;
+        }
+        if(i + 1 >= argc) {
+            std::cerr << "Missing value for " << key << std::endl;
+            return false;
+        }
+        std::string val = argv[++i];
+        try {
+            if(key == "--host")          opt.host = val;
+            else if(key == "--port")     opt.port = std::stoul(val);
+            else if(key == "--nr")       opt.params.nr = std::stoul(val);
+            else if(key == "--nc")       opt.params.nc = std::stoul(val);
+            else if(key == "--tones")    opt.params.num_tones = std::stoul(val);
+            else if(key == "--payload")  opt.params.payload_len = std::stoul(val);
+            else if(key == "--rate")     opt.rate = std::stod(val);
+            else if(key == "--burst")    opt.burst = std::stoul(val);
+            else if(key == "--senders")  opt.senders = std::stoul(val);
+            else if(key == "--duration") opt.duration = std::stod(val);
+            else if(key == "--count")    opt.count = std::stoull(val);
+            else if(key == "--seed")     opt.seed = std::stoull(val);
+            else {
+                std::cerr << "Unknown option " << key << std::endl;
+                return false;
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "Incorrect value for " << key << ": " << val << std::endl;
+            return false;
+        }
+    }
+
+    //fill_csi_matrix decodes into COMPLEX[3][3][114]
+    if(opt.params.nr < 1 || opt.params.nr > 3 || opt.params.nc < 1 || opt.params.nc > 3 ||
+       opt.params.num_tones < 1 || opt.params.num_tones > 114) {
+        std::cerr << "nr and nc must be in 1..3, tones in 1..114" << std::endl;
+        return false;
+    }
+    if(opt.rate <= 0 || opt.burst == 0 || opt.senders == 0) {
+        std::cerr << "rate, burst and senders must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct SenderStats {
+    std::atomic<uint64_t> packets = 0;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> errors = 0;
+};
+
+void sender(std::stop_token stoken, const Options& opt, size_t senderIdx, SenderStats& stats) {
+    sf::UdpSocket socket;
+    const sf::IpAddress address(opt.host);
+    if(address == sf::IpAddress::None) {
+        std::cerr << "Unable to resolve " << opt.host << std::endl;
+        return;
+    }
+
+    CsiPacketEncoder encoder(opt.params, opt.seed + senderIdx);
+    std::vector<unsigned char> datagram;
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const auto burstPeriod = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(opt.burst) / opt.rate));
+    auto nextBurst = start;
+    uint64_t sent = 0;
+
+    while(!stoken.stop_requested() && !stopRequested) {
+        for(size_t i = 0; i < opt.burst; i++) {
+            double time = std::chrono::duration<double>(clock::now() - start).count();
+            uint64_t tsf = static_cast<uint64_t>(time * 1e6);   //TSF ticks in microseconds
+            encoder.encodeSynthetic(datagram, tsf, time);
+
+            if(socket.send(datagram.data(), datagram.size(), address, opt.port) == sf::Socket::Status::Done) {
+                stats.packets++;
+                stats.bytes += datagram.size();
+            }
+            else {
+                stats.errors++;
+            }
+
+            if(opt.count && ++sent >= opt.count)
+                return;
+        }
+        nextBurst += burstPeriod;
+        std::this_thread::sleep_until(nextBurst);
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if(!parseOptions(argc, argv, opt))
+        return 1;
+
+    std::signal(SIGINT, [](int) { stopRequested = true; });
+    std::signal(SIGTERM, [](int) { stopRequested = true; });
+
+    std::vector<SenderStats> stats(opt.senders);
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for(size_t i = 0; i < opt.senders; i++) {
+            threads.emplace_back(sender, std::cref(opt), i, std::ref(stats[i]));
+        }
+
+        uint64_t lastPackets = 0;
+        while(!stopRequested) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            uint64_t packets = 0, bytes = 0, errors = 0;
+            for(const auto& s : stats) {
+                packets += s.packets;
+                bytes += s.bytes;
+                errors += s.errors;
+            }
+            std::cout << "sent " << packets << " packets (" << packets - lastPackets << "/s), "
+                      << bytes << " bytes, " << errors << " errors" << std::endl;
+            lastPackets = packets;
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            bool allDone = opt.count && packets + errors >= opt.count * opt.senders;
+            if(allDone || (opt.duration > 0 && elapsed >= opt.duration))
+                break;
+        }
+        for(auto& t : threads) {
+            t.request_stop();
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t packets = 0;
+    for(const auto& s : stats) {
+        packets += s.packets;
+    }
+    std::cout << "total " << packets << " packets in " << elapsed << " s, "
+              << packets / elapsed << " packets/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Embeds the GLSL shaders of the project root into include/embedded_shaders.hpp,
+# so the plot doesn't depend on the working directory. Run from the project
+# root, the build runs it before compiling. The header is rewritten only if
+# its contents change, so it doesn't trigger rebuilds.
+
+set -e
+
+out="include/embedded_shaders.hpp"
+tmp="$out.tmp"
+
+{
+    echo "#pragma once"
+    echo
+    echo "//Generated by tools/embed_shaders.sh from the *.glsl files, don't edit."
+    echo
+    echo "namespace EmbeddedShaders {"
+    for file in *.glsl; do
+        name="${file%.glsl}"
+        if grep -q ')glsl"' "$file"; then
+            echo "$file contains the raw string delimiter" >&2
+            exit 1
+        fi
+        echo
+        printf 'inline constexpr const char* %s = R"glsl(' "$name"
+        cat "$file"
+        echo ')glsl";'
+    done
+    echo
+    echo "} // namespace EmbeddedShaders"
+} > "$tmp"
+
+if cmp -s "$tmp" "$out"; then
+    rm "$tmp"
+else
+    mv "$tmp" "$out"
+fi
@@ -0,0 +1,116 @@
+//Example client of the live frame bus (see frame_bus.hpp).
+//Follows the frames published by a running capture (GUI or capture
+//daemon started with DBC_FRAME_BUS set) and prints the rate, lost frames
+//and the amplitude of one stream once a second.
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+
+#include "frame_bus.hpp"
+
+namespace
+{
+std::atomic<bool> stopRequested = false;
+
+struct Options {
+    std::string name = "/dbc_frames";
+    size_t stream = 0;          //(rx * nc + tx) * ns + subcarrier
+    double duration = 0;        //seconds, 0 means until interrupted
+};
+
+void printUsage(const char* name) {
+    std::cout << "Usage: " << name << " [options]\n"
+              << "  --bus NAME         shared memory name of the bus (/dbc_frames)\n"
+              << "  --stream N         stream whose amplitude is printed (0)\n"
+              << "  --duration SEC     stop after SEC seconds (0 = never)\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for(int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if(key == "--help" || key == "-h") {
+            printUsage(argv[0]);
+            return false;
+        }
+        if(i + 1 >= argc) {
+            std::cerr << "Missing value for " << key << std::endl;
+            return false;
+        }
+        std::string val = argv[++i];
+        try {
+            if(key == "--bus")           opt.name = val;
+            else if(key == "--stream")   opt.stream = std::stoul(val);
+            else if(key == "--duration") opt.duration = std::stod(val);
+            else {
+                std::cerr << "Unknown option " << key << std::endl;
+                return false;
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "Incorrect value for " << key << ": " << val << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if(!parseOptions(argc, argv, opt))
+        return 1;
+
+    std::signal(SIGINT, [](int) { stopRequested = true; });
+    std::signal(SIGTERM, [](int) { stopRequested = true; });
+
+    auto reader = FrameBus::Reader::open(opt.name);
+    if(!reader) {
+        std::cerr << "No frame bus " << opt.name << std::endl;
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    auto nextReport = start + std::chrono::seconds(1);
+    uint64_t frames = 0;
+    double amplitude = 0;
+    uint16_t source = 0;
+
+    while(!stopRequested) {
+        //amplitude is computed in place, it's kept only if the frame wasn't overwritten meanwhile
+        double value = 0;
+        uint16_t valueSource = 0;
+        auto status = reader->next([&opt, &value, &valueSource](const FrameBus::Reader::FrameView& view) {
+            valueSource = view.meta->sourceId;
+            if(opt.stream < view.meta->values())
+                value = std::hypot(view.re[opt.stream], view.im[opt.stream]);
+        });
+        if(status == FrameBus::Reader::Status::Ok) {
+            frames++;
+            amplitude = value;
+            source = valueSource;
+        }
+        else if(status == FrameBus::Reader::Status::NotYet) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        auto now = clock::now();
+        if(now >= nextReport) {
+            std::cout << frames << " frames/s, lost " << reader->lost() << ", source " << source
+                      << ", amplitude " << amplitude << std::endl;
+            frames = 0;
+            nextReport += std::chrono::seconds(1);
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            if(opt.duration > 0 && elapsed >= opt.duration)
+                break;
+        }
+    }
+    return 0;
+}